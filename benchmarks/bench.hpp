@@ -0,0 +1,143 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// The harness the benchmarks share. Every case reports ns per element, GB/s
+// when it moves bytes (bytes read plus bytes written), and optionally a rate
+// in a unit of its own, such as GFlop/s. Build in Release.
+//
+//   <benchmark> [--json] [--filter=<substring>] [--min-time=<seconds>]
+//
+// --json prints one JSON array for tracking regressions; --filter runs the
+// cases whose name contains the substring; --min-time is how long each case
+// repeats for.
+
+struct options {
+  bool json = false;
+  std::string filter;
+  double min_time = 0.2;
+};
+
+//! The options in argv; prints the usage and exits on anything else
+inline options parse_options(int argc, char **argv) {
+  options opts;
+  for (int i = 1; i != argc; ++i) {
+    if (std::strcmp(argv[i], "--json") == 0)
+      opts.json = true;
+    else if (std::strncmp(argv[i], "--filter=", 9) == 0)
+      opts.filter = argv[i] + 9;
+    else if (std::strncmp(argv[i], "--min-time=", 11) == 0)
+      opts.min_time = std::atof(argv[i] + 11);
+    else {
+      std::fprintf(stderr,
+                   "usage: %s [--json] [--filter=<substring>] "
+                   "[--min-time=<seconds>]\n",
+                   argv[0]);
+      std::exit(2);
+    }
+  }
+  return opts;
+}
+
+//! A rate of a case's own: per_call units of work per call, reported per
+//! second in unit, e.g. {"GFlop/s", flops * 1e-9}
+struct rate {
+  const char *unit;
+  double per_call;
+};
+
+struct result {
+  std::string name, type;
+  std::size_t n;   // the size of the case, as the case defines it
+  double elements; // per call
+  double bytes;    // per call
+  rate work;       // per call; no unit for none
+  double seconds;  // per call
+};
+
+//! Seconds per call of f, repeating it until min_time has passed
+template <typename F> double seconds(F f, double min_time) {
+  f(); // warm up
+  for (std::size_t reps = 1;; reps *= 2) {
+    auto t0 = std::chrono::steady_clock::now();
+    for (std::size_t r = 0; r != reps; ++r)
+      f();
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - t0;
+    if (d.count() >= min_time || reps >= (std::size_t(1) << 30))
+      return d.count() / reps;
+  }
+}
+
+class suite {
+public:
+  explicit suite(const options &o) : opts_(o) {}
+
+  //! Time f, a call of which handles elements elements and moves bytes
+  //! bytes, as the case name of the given type and size
+  template <typename F>
+  void run(const char *name, const char *type, std::size_t n,
+           double elements, double bytes, F f) {
+    run(name, type, n, elements, bytes, rate{nullptr, 0}, f);
+  }
+
+  //! The same, with a rate of the case's own
+  template <typename F>
+  void run(const char *name, const char *type, std::size_t n,
+           double elements, double bytes, rate work, F f) {
+    if (std::string(name).find(opts_.filter) == std::string::npos)
+      return;
+    results_.push_back({name, type, n, elements, bytes, work,
+                        seconds(f, opts_.min_time)});
+    if (!opts_.json)
+      print(results_.back());
+  }
+
+  //! Print the JSON array, with --json
+  void finish() const {
+    if (!opts_.json)
+      return;
+    std::printf("[\n");
+    for (std::size_t i = 0; i != results_.size(); ++i) {
+      const result &r = results_[i];
+      std::printf("  {\"name\": \"%s\", \"type\": \"%s\", \"n\": %zu, "
+                  "\"ns_per_element\": %.4f, \"gb_per_s\": ",
+                  r.name.c_str(), r.type.c_str(), r.n, ns_per_element(r));
+      if (r.bytes > 0)
+        std::printf("%.3f", gb_per_s(r));
+      else
+        std::printf("null");
+      if (r.work.unit)
+        std::printf(", \"rate\": %.4f, \"unit\": \"%s\"", per_second(r),
+                    r.work.unit);
+      std::printf("}%s\n", i + 1 == results_.size() ? "" : ",");
+    }
+    std::printf("]\n");
+  }
+
+private:
+  options opts_;
+  std::vector<result> results_;
+
+  static double ns_per_element(const result &r) {
+    return r.seconds / r.elements * 1e9;
+  }
+  static double gb_per_s(const result &r) { return r.bytes / r.seconds * 1e-9; }
+  static double per_second(const result &r) {
+    return r.work.per_call / r.seconds;
+  }
+
+  static void print(const result &r) {
+    std::printf("%-32s %-7s %8zu %10.3f ns/element", r.name.c_str(),
+                r.type.c_str(), r.n, ns_per_element(r));
+    if (r.bytes > 0)
+      std::printf(" %8.2f GB/s", gb_per_s(r));
+    if (r.work.unit)
+      std::printf(" %10.2f %s", per_second(r), r.work.unit);
+    std::printf("\n");
+  }
+};
@@ -0,0 +1,82 @@
+#include "bench.hpp"
+#include "concurrent.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+
+// Scatter-add from all threads into one Matrix<double, 2>: a dense histogram
+// whose bins every thread hits often, and sparse updates over a large
+// matrix. A mutex around each update is the baseline; against it run the
+// ConcurrentAccumulator with atomic adds only, with every written region
+// privatized, and with its default adaptive switch. An element is one
+// update; n is the number of rows. Reports Mupdates/s, merge included.
+// Options as in bench.hpp.
+
+// A cheap stateless hash of u (splitmix64), so that drawing indices does
+// not dominate the timings
+inline std::uint64_t mix(std::uint64_t u) {
+  u += 0x9e3779b97f4a7c15ull;
+  u = (u ^ (u >> 30)) * 0xbf58476d1ce4e5b9ull;
+  u = (u ^ (u >> 27)) * 0x94d049bb133111ebull;
+  return u ^ (u >> 31);
+}
+
+// Runs f(thread, i, j) for the updates of every thread, the indices spread
+// uniformly over rows x cols
+template <typename F>
+void scatter(std::size_t threads, std::size_t per_thread, std::size_t rows,
+             std::size_t cols, F f) {
+  matrix_impl::parallel_tasks(threads, [&](std::size_t c) {
+    for (std::size_t u = 0; u != per_thread; ++u) {
+      const std::uint64_t h = mix(c * per_thread + u);
+      f(c, std::size_t(h >> 32) % rows, std::size_t(h & 0xffffffffu) % cols);
+    }
+  });
+}
+
+void run(suite &s, const std::string &label, std::size_t rows,
+         std::size_t cols, std::size_t per_thread) {
+  const std::size_t threads = num_threads(), total = threads * per_thread;
+  const rate mups{"Mupdates/s", total * 1e-6};
+  Matrix<double, 2> m(rows, cols);
+
+  std::mutex mu;
+  s.run((label + ", mutex").c_str(), "double", rows, double(total), 0, mups,
+        [&] {
+          scatter(threads, per_thread, rows, cols,
+                  [&](std::size_t, std::size_t i, std::size_t j) {
+                    std::lock_guard<std::mutex> lock(mu);
+                    m(i, j) += 1;
+                  });
+        });
+
+  struct {
+    const char *name;
+    std::size_t hot_after;
+  } modes[] = {{", atomic only",
+                std::numeric_limits<std::size_t>::max()},
+               {", privatized", 1},
+               {", adaptive", 0}};
+  for (const auto &mode : modes) {
+    s.run((label + mode.name).c_str(), "double", rows, double(total), 0, mups,
+          [&] {
+            ConcurrentAccumulator<double, 2> acc(m, threads, 0,
+                                                 mode.hot_after);
+            scatter(threads, per_thread, rows, cols,
+                    [&](std::size_t c, std::size_t i, std::size_t j) {
+                      acc.local(c).add(1.0, i, j);
+                    });
+            acc.merge();
+          });
+  }
+}
+
+int main(int argc, char **argv) {
+  suite s(parse_options(argc, argv));
+  run(s, "histogram", 256, 256, 4000000);
+  run(s, "sparse", 8192, 8192, 200000);
+  s.finish();
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include "bench.hpp"
+#include "csv.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// load_csv and stream_csv on a file of 1M rows of 8 floats against the
+// iostream loop into a vector and copy into a Matrix that they replace, at 1
+// thread and all threads. An element is one field and the bytes are those
+// of the text; n is the number of threads. Options as in bench.hpp.
+
+volatile double sink;
+
+int main(int argc, char **argv) {
+  suite s(parse_options(argc, argv));
+  const char *path = "bench_csv_data.csv";
+  const std::size_t rows = std::size_t(1) << 20, cols = 8;
+  std::size_t bytes = 0;
+  {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> u(-1000, 1000);
+    std::ofstream out(path, std::ios::binary);
+    std::string line;
+    for (std::size_t i = 0; i != rows; ++i) {
+      line.clear();
+      for (std::size_t j = 0; j != cols; ++j) {
+        char field[32];
+        std::snprintf(field, sizeof field, "%.6g%c", u(gen),
+                      j + 1 == cols ? '\n' : ',');
+        line += field;
+      }
+      out << line;
+      bytes += line.size();
+    }
+  }
+  const double e = double(rows) * cols, b = double(bytes);
+
+  s.run("iostream + copy", "float", 1, e, b, [&] {
+    std::ifstream in(path);
+    std::vector<float> v;
+    std::string line, field;
+    while (std::getline(in, line)) {
+      std::istringstream ls(line);
+      while (std::getline(ls, field, ','))
+        v.push_back(std::stof(field));
+    }
+    Matrix<float, 2> m(v.size() / cols, cols);
+    std::copy(v.begin(), v.end(), m.begin());
+    sink = m(0, 0);
+  });
+
+  for (std::size_t threads : {std::size_t(1), std::size_t(0)}) {
+    set_num_threads(threads);
+    s.run("load_csv", "float", num_threads(), e, b,
+          [&] { sink = load_csv<float>(path)(0, 0); });
+    s.run("stream_csv", "float", num_threads(), e, b, [&] {
+      stream_csv<float>(path, [](MatrixRef<const float, 2> r, std::size_t) {
+        sink = r(0, 0);
+      });
+    });
+  }
+  std::remove(path);
+  s.finish();
+  return 0;
+}
@@ -0,0 +1,44 @@
+#include "bench.hpp"
+#include "fft.hpp"
+
+#include <cmath>
+#include <random>
+
+// FFT throughput along the rows and along the first axis of Matrix<double, 2>
+// blocks, and along the time axis of a Matrix<float, 3> cube, in ns per
+// element and in GFlop/s by the usual 5 n log2(n) count per complex
+// transform (half that for rfft). n is the transform length. Options as in
+// bench.hpp.
+
+volatile double sink;
+
+int main(int argc, char **argv) {
+  suite s(parse_options(argc, argv));
+  std::mt19937 gen(42);
+  std::normal_distribution<double> g;
+
+  for (std::size_t n : {64, 1000, 1024, 4096, 65536}) {
+    const std::size_t rows = (std::size_t(1) << 22) / n;
+    Matrix<double, 2> m(rows, n);
+    m.apply([&](double &x) { x = g(gen); });
+    const double e = double(m.size());
+    const double gflop = 5.0 * n * std::log2(double(n)) * rows * 1e-9;
+
+    s.run("fft rows", "double", n, e, 0, rate{"GFlop/s", gflop},
+          [&] { sink = fft(m)(0, 1).real(); });
+    s.run("rfft rows", "double", n, e, 0, rate{"GFlop/s", gflop / 2},
+          [&] { sink = rfft(m)(0, 1).real(); });
+    Matrix<double, 2> t(n, rows);
+    t.apply([&](double &x) { x = g(gen); });
+    s.run("fft axis 0", "double", n, e, 0, rate{"GFlop/s", gflop},
+          [&] { sink = fft(t, 0)(1, 0).real(); });
+  }
+
+  Matrix<float, 3> cube(4096, 32, 32); // time x rows x cols
+  cube.apply([&](float &x) { x = float(g(gen)); });
+  s.run("rfft cube axis 0", "float", 4096, double(cube.size()), 0,
+        rate{"GFlop/s", 2.5 * 4096 * 12 * 32 * 32 * 1e-9},
+        [&] { sink = rfft(cube, 0)(1, 0, 0).real(); });
+  s.finish();
+  return 0;
+}
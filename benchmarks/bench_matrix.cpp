@@ -0,0 +1,144 @@
+#include "bench.hpp"
+#include "matrix.hpp"
+
+// The core Matrix hot paths: element access, slicing, iteration, apply,
+// construction from lists and copies between views, for a few sizes and
+// element types. Every case reports ns per element and GB/s (bytes read
+// plus bytes written); the slicing cases count views instead of elements
+// and move no bytes. Options as in bench.hpp.
+
+volatile double sink;
+
+template <typename T> struct type_name;
+template <> struct type_name<float> {
+  static const char *get() { return "float"; }
+};
+template <> struct type_name<double> {
+  static const char *get() { return "double"; }
+};
+template <> struct type_name<int> {
+  static const char *get() { return "int"; }
+};
+
+template <typename T> void run_type(suite &s, std::size_t n) {
+  const char *type = type_name<T>::get();
+  const double e = double(n) * n, b = e * sizeof(T);
+  Matrix<T, 2> m(n, n), o(n, n);
+  int k = 0;
+  for (auto &x : m)
+    x = T(k++ % 97);
+
+  s.run("access operator()", type, n, e, b, [&] {
+    T acc = 0;
+    for (std::size_t i = 0; i != n; ++i)
+      for (std::size_t j = 0; j != n; ++j)
+        acc += m(i, j);
+    sink = double(acc);
+  });
+  s.run("access operator() column", type, n, e, b, [&] {
+    T acc = 0;
+    for (std::size_t j = 0; j != n; ++j)
+      for (std::size_t i = 0; i != n; ++i)
+        acc += m(i, j);
+    sink = double(acc);
+  });
+
+  // one view per row or column; the elements are the views made
+  s.run("slice do_slice", type, n, double(n), 0, [&] {
+    std::size_t acc = 0;
+    for (std::size_t i = 0; i != n; ++i)
+      acc += m(slice{i, 1}, slice{0}).descriptor().start;
+    sink = double(acc);
+  });
+  s.run("slice rows", type, n, double(n), 0, [&] {
+    std::size_t acc = 0;
+    for (std::size_t i = 0; i != n; ++i)
+      acc += m.rows(i, i).descriptor().start;
+    sink = double(acc);
+  });
+  s.run("slice cols", type, n, double(n), 0, [&] {
+    std::size_t acc = 0;
+    for (std::size_t j = 0; j != n; ++j)
+      acc += m.cols(j, j).descriptor().start;
+    sink = double(acc);
+  });
+
+  const MatrixRef<const T, 2> ref(m);
+  const auto block = m.cols(0, n / 2 - 1);
+  const MatrixRef<const T, 2> strided_block(block);
+  s.run("iterate Matrix", type, n, e, b, [&] {
+    T acc = 0;
+    for (T x : m)
+      acc += x;
+    sink = double(acc);
+  });
+  s.run("iterate MatrixRef", type, n, e, b, [&] {
+    T acc = 0;
+    for (T x : ref)
+      acc += x;
+    sink = double(acc);
+  });
+  s.run("iterate ContiguousRef block", type, n, e / 2, b / 2, [&] {
+    T acc = 0;
+    for (T x : block)
+      acc += x;
+    sink = double(acc);
+  });
+  s.run("iterate MatrixRef block", type, n, e / 2, b / 2, [&] {
+    T acc = 0;
+    for (T x : strided_block)
+      acc += x;
+    sink = double(acc);
+  });
+
+  MatrixRef<T, 2> oref(o);
+  s.run("apply Matrix", type, n, e, 2 * b,
+        [&] { o.apply([](T &x) { x = x * T(3) + T(1); }); });
+  s.run("apply MatrixRef", type, n, e, 2 * b,
+        [&] { oref.apply([](T &x) { x = x * T(3) + T(1); }); });
+  s.run("apply Matrix, Matrix", type, n, e, 3 * b,
+        [&] { o.apply(m, [](T &x, const T &y) { x += y; }); });
+
+  s.run("copy Matrix(Matrix)", type, n, e, 2 * b, [&] {
+    Matrix<T, 2> c(m);
+    sink = double(c(n - 1, n - 1));
+  });
+  s.run("copy Matrix(MatrixRef block)", type, n, e / 2, b, [&] {
+    Matrix<T, 2> c(block);
+    sink = double(c(n - 1, 0));
+  });
+  s.run("copy MatrixRef = MatrixRef", type, n, e, 2 * b,
+        [&] { oref = ref; });
+  Matrix<T, 2, column_major> cm(n, n);
+  s.run("copy column_major = Matrix", type, n, e, 2 * b, [&] { cm = m; });
+}
+
+// A literal 8 x 8 list; elements are those of one construction
+template <typename T> void run_list(suite &s) {
+  const char *type = type_name<T>::get();
+  s.run("construct from list", type, 8, 64, 64 * sizeof(T), [&] {
+    Matrix<T, 2> m = {{0, 1, 2, 3, 4, 5, 6, 7},
+                      {1, 2, 3, 4, 5, 6, 7, 8},
+                      {2, 3, 4, 5, 6, 7, 8, 9},
+                      {3, 4, 5, 6, 7, 8, 9, 10},
+                      {4, 5, 6, 7, 8, 9, 10, 11},
+                      {5, 6, 7, 8, 9, 10, 11, 12},
+                      {6, 7, 8, 9, 10, 11, 12, 13},
+                      {7, 8, 9, 10, 11, 12, 13, 14}};
+    sink = double(m(7, 7));
+  });
+}
+
+int main(int argc, char **argv) {
+  suite s(parse_options(argc, argv));
+  for (std::size_t n : {64, 512, 2048}) {
+    run_type<float>(s, n);
+    run_type<double>(s, n);
+    run_type<int>(s, n);
+  }
+  run_list<float>(s);
+  run_list<double>(s);
+  run_list<int>(s);
+  s.finish();
+  return 0;
+}
@@ -0,0 +1,40 @@
+#include "bench.hpp"
+#include "matrix_ops.hpp"
+#include "quantized.hpp"
+
+#include <random>
+
+// Throughput of the int8 GEMM against the float one, in GOP/s (one multiply
+// and one add per inner step); an element is one output. The VNNI or AVX2
+// kernels are picked at run time (see dispatch.hpp), so no -march flag is
+// needed. Options as in bench.hpp.
+
+int main(int argc, char **argv) {
+  suite s(parse_options(argc, argv));
+  std::mt19937 gen(42);
+  std::normal_distribution<float> u(0, 1);
+
+  for (std::size_t n : {256, 512, 1024}) {
+    // activations x (m x k) times the transpose of weights w (n x k)
+    const std::size_t m = 4 * n, k = n;
+    Matrix<float, 2> x(m, k), w(n, k), wt(k, n);
+    x.apply([&](float &v) { v = u(gen); });
+    w.apply([&](float &v) { v = u(gen); });
+    for (std::size_t i = 0; i != n; ++i)
+      for (std::size_t p = 0; p != k; ++p)
+        wt(p, i) = w(i, p);
+    const QuantizedMatrix qx = quantize(x);
+    const QuantizedMatrix qw = quantize(w, quantization::per_row);
+    const double e = double(m) * n;
+    const rate gop{"GOP/s", 2.0 * m * n * k * 1e-9};
+
+    s.run("float multiply", "float", n, e, 0, gop, [&] { multiply(x, wt); });
+    s.run("int8 qgemm_s32", "int8", n, e, 0, gop, [&] { qgemm_s32(qx, qw); });
+    s.run("int8 qgemm (dequantized)", "int8", n, e, 0, gop,
+          [&] { qgemm(qx, qw); });
+    s.run("quantize + qgemm", "int8", n, e, 0, gop,
+          [&] { qgemm(quantize(x), qw); });
+  }
+  s.finish();
+  return 0;
+}
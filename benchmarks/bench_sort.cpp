@@ -0,0 +1,55 @@
+#include "bench.hpp"
+#include "sort.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <vector>
+
+// topk along the rows of a Matrix<float, 2> against the copy of each row into
+// a vector and std::partial_sort that it replaces, for a few row lengths,
+// and sort() of rows and columns in place. n is the length of the sorted
+// lines. Options as in bench.hpp.
+
+volatile float sink;
+
+int main(int argc, char **argv) {
+  suite s(parse_options(argc, argv));
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<float> u;
+  const std::size_t k = 100;
+
+  for (std::size_t cols : {std::size_t(1) << 14, std::size_t(1) << 20}) {
+    const std::size_t rows = (std::size_t(1) << 24) / cols;
+    Matrix<float, 2> m(rows, cols);
+    m.apply([&](float &x) { x = u(gen); });
+    const double e = double(m.size()), b = e * sizeof(float);
+
+    s.run("topk 100", "float", cols, e, b,
+          [&] { sink = topk(m, k).values(0, 0); });
+    std::vector<float> row(cols);
+    s.run("copy + std::partial_sort 100", "float", cols, e, b, [&] {
+      for (std::size_t i = 0; i != rows; ++i) {
+        std::copy(m.row(i).begin(), m.row(i).end(), row.begin());
+        std::partial_sort(row.begin(), row.begin() + k, row.end(),
+                          std::greater<float>());
+        sink = row[0];
+      }
+    });
+    s.run("sort rows", "float", cols, e, 0, [&] {
+      Matrix<float, 2> c = m;
+      sort(c);
+      sink = c(0, 0);
+    });
+  }
+
+  Matrix<float, 2> t(4096, 1024);
+  t.apply([&](float &x) { x = u(gen); });
+  s.run("sort columns", "float", 4096, double(t.size()), 0, [&] {
+    Matrix<float, 2> c = t;
+    sort(c, 0);
+    sink = c(0, 0);
+  });
+  s.finish();
+  return 0;
+}
@@ -0,0 +1,64 @@
+#include "bench.hpp"
+#include "stencil.hpp"
+
+#include <random>
+
+// Throughput of the stencil engine in Mpixel/s, against the nested
+// operator()(i, j) loop it replaces, on n x n images. Options as in
+// bench.hpp.
+
+Matrix<float, 2> naive(const Matrix<float, 2> &in, const Matrix<float, 2> &k) {
+  const long rows = in.n_rows(), cols = in.n_cols();
+  const long kh = k.n_rows(), kw = k.n_cols();
+  Matrix<float, 2> out(rows, cols);
+  for (long i = 0; i != rows; ++i)
+    for (long j = 0; j != cols; ++j) {
+      float s = 0;
+      for (long a = 0; a != kh; ++a)
+        for (long b = 0; b != kw; ++b) {
+          const long y = i + a - kh / 2, x = j + b - kw / 2;
+          if (y >= 0 && y < rows && x >= 0 && x < cols)
+            s += k(a, b) * in(y, x);
+        }
+      out(i, j) = s;
+    }
+  return out;
+}
+
+int main(int argc, char **argv) {
+  suite s(parse_options(argc, argv));
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<float> u(0, 1);
+
+  Matrix<float, 2> laplacian = {{0, 1, 0}, {1, -4, 1}, {0, 1, 0}};
+  Matrix<float, 2> box5(5, 5);
+  box5.apply([](float &x) { x = 1.f / 25; });
+  Matrix<float, 1> gauss5 = {1.f / 16, 4.f / 16, 6.f / 16, 4.f / 16, 1.f / 16};
+
+  for (std::size_t n : {512, 2048, 4096}) {
+    Matrix<float, 2> img(n, n);
+    img.apply([&](float &x) { x = u(gen); });
+    const double px = double(n) * n, b = 2 * px * sizeof(float);
+    const rate mpx{"Mpixel/s", px * 1e-6};
+
+    s.run("naive 3x3", "float", n, px, b, mpx,
+          [&] { naive(img, laplacian); });
+    s.run("laplacian 3x3 zero", "float", n, px, b, mpx,
+          [&] { convolve(img, laplacian); });
+    s.run("laplacian 3x3 wrap", "float", n, px, b, mpx,
+          [&] { convolve(img, laplacian, boundary::wrap); });
+    s.run("box 5x5 clamp", "float", n, px, b, mpx,
+          [&] { convolve(img, box5, boundary::clamp); });
+    s.run("gauss 5x5 separable", "float", n, px, b, mpx,
+          [&] { convolve_separable(img, gauss5, gauss5, boundary::clamp); });
+  }
+
+  Matrix<float, 3> rgb(3, 2048, 2048);
+  rgb.apply([&](float &x) { x = u(gen); });
+  const double px = double(rgb.size());
+  s.run("gauss 5x5 separable rgb", "float", 2048, px,
+        2 * px * sizeof(float), rate{"Mpixel/s", px * 1e-6},
+        [&] { convolve_separable(rgb, gauss5, gauss5, boundary::clamp); });
+  s.finish();
+  return 0;
+}
@@ -0,0 +1,71 @@
+#include "bench.hpp"
+#include "matrix.hpp"
+
+#include <random>
+
+// Row-wise loops over a row-major Matrix, once through the
+// ContiguousRef that row() returns and once through the same row as a plain
+// MatrixRef, whose iterator and apply() do not know the stride is 1. The
+// gain is largest where apply() walks a block line by line. n is the number
+// of columns. Options as in bench.hpp.
+
+volatile int sink;
+
+int main(int argc, char **argv) {
+  suite s(parse_options(argc, argv));
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> u(0, 99);
+
+  for (std::size_t cols : {16, 256, 4096}) {
+    const std::size_t rows = (std::size_t(1) << 16) / cols;
+    Matrix<int, 2> m(rows, cols);
+    m.apply([&](int &x) { x = u(gen); });
+    const double e = double(m.size()), b = e * sizeof(int);
+
+    s.run("row sum, ContiguousRef", "int", cols, e, b, [&] {
+      int acc = 0;
+      for (std::size_t i = 0; i != rows; ++i)
+        for (int x : m.row(i))
+          acc += x;
+      sink = acc;
+    });
+    s.run("row sum, MatrixRef", "int", cols, e, b, [&] {
+      int acc = 0;
+      for (std::size_t i = 0; i != rows; ++i)
+        for (int x : MatrixRef<int, 1>(m.row(i)))
+          acc += x;
+      sink = acc;
+    });
+    s.run("row scale, ContiguousRef", "int", cols, e, 2 * b, [&] {
+      for (std::size_t i = 0; i != rows; ++i)
+        m.row(i).apply([](int &x) { x = x * 3 + 1; });
+    });
+    s.run("row scale, MatrixRef", "int", cols, e, 2 * b, [&] {
+      for (std::size_t i = 0; i != rows; ++i)
+        MatrixRef<int, 1>(m.row(i)).apply([](int &x) { x = x * 3 + 1; });
+    });
+
+    auto block = m.cols(0, cols / 2 - 1);
+    MatrixRef<int, 2> strided(block);
+    s.run("column block sum, ContiguousRef", "int", cols, e / 2, b / 2, [&] {
+      int acc = 0;
+      for (int x : block)
+        acc += x;
+      sink = acc;
+    });
+    s.run("column block sum, MatrixRef", "int", cols, e / 2, b / 2, [&] {
+      int acc = 0;
+      for (int x : strided)
+        acc += x;
+      sink = acc;
+    });
+    s.run("column block scale, ContiguousRef", "int", cols, e / 2, b, [&] {
+      block.apply([](int &x) { x = x * 3 + 1; });
+    });
+    s.run("column block scale, MatrixRef", "int", cols, e / 2, b, [&] {
+      strided.apply([](int &x) { x = x * 3 + 1; });
+    });
+  }
+  s.finish();
+  return 0;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace matrix_impl {
+// std::vector<bool> packs its elements into bits and has no data(), so a
+// Matrix<bool, N> keeps them in this minimal vector of real bools instead.
+// It provides the part of the std::vector interface Matrix relies on.
+class bool_vector {
+public:
+  using value_type = bool;
+  using iterator = bool *;
+  using const_iterator = const bool *;
+
+  bool_vector() : size_{0}, cap_{0} {}
+  explicit bool_vector(std::size_t n) : bool_vector() { resize(n); }
+  // a moved-from bool_vector is empty, as a moved-from std::vector is
+  bool_vector(bool_vector &&x) noexcept
+      : elems_(std::move(x.elems_)), size_{x.size_}, cap_{x.cap_} {
+    x.size_ = x.cap_ = 0;
+  }
+  bool_vector &operator=(bool_vector &&x) noexcept {
+    if (this != &x) {
+      elems_ = std::move(x.elems_);
+      size_ = x.size_;
+      cap_ = x.cap_;
+      x.size_ = x.cap_ = 0;
+    }
+    return *this;
+  }
+  bool_vector(const bool_vector &x) : bool_vector() {
+    assign(x.begin(), x.end());
+  }
+  bool_vector &operator=(const bool_vector &x) {
+    if (this != &x)
+      assign(x.begin(), x.end());
+    return *this;
+  }
+
+  std::size_t size() const { return size_; }
+  std::size_t capacity() const { return cap_; }
+  bool empty() const { return size_ == 0; }
+
+  bool *data() { return elems_.get(); }
+  const bool *data() const { return elems_.get(); }
+
+  bool &operator[](std::size_t i) { return elems_[i]; }
+  const bool &operator[](std::size_t i) const { return elems_[i]; }
+
+  iterator begin() { return data(); }
+  const_iterator begin() const { return data(); }
+  const_iterator cbegin() const { return data(); }
+  iterator end() { return data() + size_; }
+  const_iterator end() const { return data() + size_; }
+  const_iterator cend() const { return data() + size_; }
+
+  void reserve(std::size_t n) {
+    if (n <= cap_)
+      return;
+    std::unique_ptr<bool[]> p(new bool[n]);
+    std::copy(begin(), end(), p.get());
+    elems_.swap(p);
+    cap_ = n;
+  }
+
+  void shrink_to_fit() {
+    if (size_ == cap_)
+      return;
+    std::unique_ptr<bool[]> p(size_ == 0 ? nullptr : new bool[size_]);
+    std::copy(begin(), end(), p.get());
+    elems_.swap(p);
+    cap_ = size_;
+  }
+
+  void resize(std::size_t n, bool v = false) {
+    reserve(n);
+    if (n > size_)
+      std::fill(end(), data() + n, v);
+    size_ = n;
+  }
+
+  void clear() { size_ = 0; }
+
+  void push_back(bool v) {
+    if (size_ == cap_)
+      reserve(std::max<std::size_t>(2 * cap_, 8));
+    elems_[size_++] = v;
+  }
+
+  template <typename I> void assign(I first, I last) {
+    clear();
+    insert(end(), first, last);
+  }
+
+  //! only appending is supported
+  template <typename I> iterator insert(const_iterator pos, I first, I last) {
+    assert(pos == end());
+    const std::size_t at = pos - begin();
+    for (; first != last; ++first)
+      push_back(*first);
+    return begin() + at;
+  }
+
+private:
+  std::unique_ptr<bool[]> elems_;
+  std::size_t size_, cap_;
+};
+
+// The container a Matrix<T, N> keeps its elements in
+template <typename T> struct Storage { using type = std::vector<T>; };
+template <> struct Storage<bool> { using type = bool_vector; };
+} // namespace matrix_impl
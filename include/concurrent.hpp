@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+// Sharing a matrix between threads.
+//
+// partition() and tiles() split a matrix into views that do not overlap, so
+// that each thread can write its own piece without locking.
+//
+// A ConcurrentAccumulator sums scattered updates from several threads into
+// a matrix, e.g. a histogram or the gradients of a scatter-add. The matrix is
+// divided into regions of a few rows. A thread adds into a region with
+// atomic adds until it has updated that region often enough to call it hot;
+// from then on it adds into a private copy of the region, which merge()
+// folds into the matrix. Dense updates thus run uncontended on private
+// copies, while sparse ones cost no copies.
+
+namespace concurrent_impl {
+// The element type of the views into M: const for a const M
+template <typename M>
+using Elem = typename std::remove_pointer<decltype(
+    std::declval<typename std::remove_reference<M>::type &>().data())>::type;
+
+template <typename M>
+using View = MatrixRef<Elem<M>, std::remove_reference<M>::type::order()>;
+
+// d restricted to [first, last) along axis
+template <std::size_t N>
+MatrixSlice<N> sub(MatrixSlice<N> d, std::size_t axis, std::size_t first,
+                   std::size_t last) {
+  d.start += first * d.strides[axis];
+  d.extents[axis] = last - first;
+  d.size = matrix_impl::compute_size(d.extents);
+  return d;
+}
+
+// *p += v as one atomic step, for element types the hardware can swap whole
+template <typename T> void atomic_add(T *p, T v) {
+  T old, next;
+  __atomic_load(p, &old, __ATOMIC_RELAXED);
+  do
+    next = old + v;
+  while (!__atomic_compare_exchange(p, &old, &next, true, __ATOMIC_RELAXED,
+                                    __ATOMIC_RELAXED));
+}
+} // namespace concurrent_impl
+
+//! m split along axis into k views of consecutive indices, as equal as
+//! possible; fewer when m.extent(axis) < k. The views do not overlap.
+template <typename M>
+Enable_if<Matrix_type<typename std::remove_reference<M>::type>(),
+          std::vector<concurrent_impl::View<M>>>
+partition(M &&m, std::size_t axis, std::size_t k) {
+  using V = concurrent_impl::View<M>;
+  const auto &d = m.descriptor();
+  assert(axis < d.extents.size() && k >= 1);
+  const std::size_t n = d.extents[axis];
+  k = std::min(k, n);
+  std::vector<V> parts;
+  parts.reserve(k);
+  for (std::size_t c = 0; c != k; ++c)
+    parts.push_back(
+        V(concurrent_impl::sub(d, axis, n * c / k, n * (c + 1) / k), m.data()));
+  return parts;
+}
+
+//! The 2-D m split into tiles of rows x cols elements (smaller along the
+//! last row and column of tiles), row of tiles by row of tiles. The tiles do
+//! not overlap.
+template <typename M>
+Enable_if<Matrix_type<typename std::remove_reference<M>::type>(),
+          std::vector<concurrent_impl::View<M>>>
+tiles(M &&m, std::size_t rows, std::size_t cols) {
+  using V = concurrent_impl::View<M>;
+  static_assert(std::remove_reference<M>::type::order() == 2,
+                "tiles: only 2-D matrices");
+  assert(rows >= 1 && cols >= 1);
+  const auto &d = m.descriptor();
+  std::vector<V> out;
+  out.reserve(((d.extents[0] + rows - 1) / rows) *
+              ((d.extents[1] + cols - 1) / cols));
+  for (std::size_t i = 0; i < d.extents[0]; i += rows) {
+    const auto band =
+        concurrent_impl::sub(d, 0, i, std::min(i + rows, d.extents[0]));
+    for (std::size_t j = 0; j < d.extents[1]; j += cols)
+      out.push_back(V(concurrent_impl::sub(band, 1, j,
+                                           std::min(j + cols, d.extents[1])),
+                      m.data()));
+  }
+  return out;
+}
+
+//! Sums of updates from several threads into a matrix (see the top of the
+//! file). Thread c, in [0, threads), adds through local(c) only; no two
+//! threads may share a local. The matrix holds the atomic updates at once
+//! but the private ones only after merge(), which must run once the
+//! threads are done. The matrix must outlive the accumulator, which can be
+//! neither copied nor moved.
+template <typename T, std::size_t N> class ConcurrentAccumulator {
+  static_assert(std::is_arithmetic<T>::value && sizeof(T) <= 8,
+                "ConcurrentAccumulator: elements must be atomically addable");
+
+public:
+  using value_type = T;
+
+  //! Regions of region_rows indices along the first dimension (0: about
+  //! 4096 elements); a thread privatizes a region after hot_after updates
+  //! to it (0: one per 32 of its elements). 1 privatizes every region
+  //! written, std::numeric_limits<std::size_t>::max() only adds atomically.
+  ConcurrentAccumulator(MatrixRef<T, N> target, std::size_t threads,
+                        std::size_t region_rows = 0, std::size_t hot_after = 0)
+      : target_(target), row_size_(1) {
+    const MatrixSlice<N> &d = target_.descriptor();
+    for (std::size_t i = 1; i != N; ++i)
+      row_size_ *= d.extents[i];
+    rows_ = region_rows != 0
+                ? region_rows
+                : std::max<std::size_t>(1, 4096 / std::max<std::size_t>(
+                                                     row_size_, 1));
+    regions_ = (d.extents[0] + rows_ - 1) / rows_;
+    hot_after_ = hot_after != 0
+                     ? hot_after
+                     : std::max<std::size_t>(1, rows_ * row_size_ / 32);
+    for (std::size_t c = 0; c != threads; ++c)
+      locals_.emplace_back(new Local(*this));
+  }
+
+  // the locals point back at the accumulator that made them
+  ConcurrentAccumulator(const ConcurrentAccumulator &) = delete;
+  ConcurrentAccumulator &operator=(const ConcurrentAccumulator &) = delete;
+
+  //! The updates of one thread
+  class Local {
+  public:
+    explicit Local(ConcurrentAccumulator &acc)
+        : acc_(&acc), count_(acc.regions_, 0), copy_(acc.regions_) {}
+
+    //! add v to the element at (i, j, ...)
+    template <typename... Idx> void add(T v, Idx... idx) {
+      static_assert(sizeof...(Idx) == N, "ConcurrentAccumulator: N indices");
+      const std::size_t at[N] = {std::size_t(idx)...};
+      const MatrixSlice<N> &d = acc_->target_.descriptor();
+      std::size_t off = d.start, in_row = 0;
+      for (std::size_t i = 0; i != N; ++i) {
+        assert(at[i] < d.extents[i]);
+        off += at[i] * d.strides[i];
+        if (i != 0)
+          in_row = in_row * d.extents[i] + at[i];
+      }
+      const std::size_t r = at[0] / acc_->rows_;
+      if (!copy_[r] && ++count_[r] >= acc_->hot_after_)
+        copy_[r].reset(new T[acc_->rows_ * acc_->row_size_]());
+      if (copy_[r])
+        copy_[r][(at[0] % acc_->rows_) * acc_->row_size_ + in_row] += v;
+      else
+        concurrent_impl::atomic_add(acc_->target_.data() + off, v);
+    }
+
+  private:
+    friend class ConcurrentAccumulator;
+    ConcurrentAccumulator *acc_;
+    std::vector<std::size_t> count_;         // updates per region
+    std::vector<std::unique_ptr<T[]>> copy_; // private regions, once hot
+  };
+
+  //! the updates of thread c
+  Local &local(std::size_t c) {
+    assert(c < locals_.size());
+    return *locals_[c];
+  }
+
+  //! Add the private copies into the matrix, region by region in parallel,
+  //! and zero them for the next round (hot regions stay private)
+  void merge() {
+    const MatrixSlice<N> &d = target_.descriptor();
+    const std::size_t len = d.extents[N - 1];
+    matrix_impl::parallel_for(
+        0, regions_,
+        std::max<std::size_t>(1, 32768 / std::max<std::size_t>(
+                                             rows_ * row_size_, 1)),
+        [&](std::size_t first, std::size_t last) {
+          for (std::size_t r = first; r != last; ++r) {
+            const MatrixSlice<N> rd = concurrent_impl::sub(
+                d, 0, r * rows_, std::min((r + 1) * rows_, d.extents[0]));
+            for (const auto &l : locals_) {
+              T *p = l->copy_[r].get();
+              if (!p)
+                continue;
+              for (std::size_t k = 0; k != matrix_impl::line_count(rd); ++k) {
+                T *q = target_.data() + matrix_impl::line_offset(rd, k);
+                for (std::size_t e = 0; e != len; ++e)
+                  q[e * d.strides[N - 1]] += p[k * len + e];
+              }
+              std::fill(p, p + rows_ * row_size_, T(0));
+            }
+          }
+        });
+  }
+
+  //! regions held privately, over all threads
+  std::size_t private_regions() const {
+    std::size_t n = 0;
+    for (const auto &l : locals_)
+      for (const auto &p : l->copy_)
+        n += p != nullptr;
+    return n;
+  }
+
+private:
+  MatrixRef<T, N> target_;
+  std::size_t row_size_, rows_, regions_, hot_after_;
+  std::vector<std::unique_ptr<Local>> locals_;
+};
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+
+#include "matrix_fwd.hpp"
+#include "matrix_impl.hpp"
+#include "matrix_ref.hpp"
+
+// A MatrixRef whose last dimension is statically known to have stride 1, as
+// are the rows, row blocks and column blocks of a row-major Matrix and the
+// tiles of a tiled one. It is a MatrixRef, so everything taking one accepts
+// it, but its iterators and apply() walk each line with a plain pointer: a
+// 1-D ContiguousRef iterates with T *, which the compiler vectorizes, where
+// MatrixRefIterator carries an index per dimension and a runtime stride.
+
+template <typename T, std::size_t N> class ContiguousRefIterator;
+
+namespace matrix_impl {
+// The iterator of a ContiguousRef: a plain pointer for a single line
+template <typename T, std::size_t N> struct contiguous_iter {
+  using type = ContiguousRefIterator<T, N>;
+  static type make(const MatrixSlice<N> &d, T *p, bool limit) {
+    return {d, p, limit};
+  }
+};
+
+template <typename T> struct contiguous_iter<T, 1> {
+  using type = T *;
+  static type make(const MatrixSlice<1> &d, T *p, bool limit) {
+    return p + d.start + (limit ? d.size : 0);
+  }
+};
+
+// f(q, r, n) for the matching lines of (ad, ap) and (bd, bp), both of unit
+// last stride: q and r point at their n elements
+template <std::size_t N, typename T, typename U, typename F>
+void for_each_line(const MatrixSlice<N> &ad, T *ap, const MatrixSlice<N> &bd,
+                   U *bp, F f) {
+  const std::size_t lines = line_count(ad), len = ad.extents[N - 1];
+  for (std::size_t l = 0; l != lines; ++l)
+    f(ap + line_offset(ad, l), bp + line_offset(bd, l), len);
+}
+} // namespace matrix_impl
+
+//! A view whose order N - 1 is dense (last stride 1); N >= 1
+template <typename T, std::size_t N>
+using Unit_view = typename std::conditional<(N >= 1), ContiguousRef<T, N>,
+                                            MatrixRef<T, N>>::type;
+
+template <typename T, std::size_t N>
+class ContiguousRef : public MatrixRef<T, N> {
+  static_assert(N >= 1, "ContiguousRef: order must be at least 1");
+
+public:
+  //! @cond Doxygen_Suppress
+  using iterator = typename matrix_impl::contiguous_iter<T, N>::type;
+  using const_iterator =
+      typename matrix_impl::contiguous_iter<const T, N>::type;
+
+  ContiguousRef(const ContiguousRef &) = default;
+  ContiguousRef(ContiguousRef &&) = default;
+  ContiguousRef &operator=(const ContiguousRef &) = default;
+  ContiguousRef &operator=(ContiguousRef &&) = default;
+  //! @endcond
+
+  ContiguousRef(const MatrixSlice<N> &s, T *p) : MatrixRef<T, N>{s, p} {
+    assert(s.strides[N - 1] == 1);
+  }
+
+  //! construct from ContiguousRef (e.g. non-const to const)
+  template <typename U>
+  ContiguousRef(const ContiguousRef<U, N> &x)
+      : MatrixRef<T, N>{x.descriptor(), x.data()} {}
+
+  //! assign elements, as MatrixRef does
+  using MatrixRef<T, N>::operator=;
+
+  //! m[i] row access
+  ///@{
+  Unit_view<T, N - 1> operator[](std::size_t i) { return row(i); }
+  Unit_view<const T, N - 1> operator[](std::size_t i) const { return row(i); }
+  ///@}
+
+  //! row access
+  ///@{
+  Unit_view<T, N - 1> row(std::size_t n) {
+    return unit(MatrixRef<T, N>::row(n));
+  }
+  Unit_view<const T, N - 1> row(std::size_t n) const {
+    return unit(MatrixRef<T, N>::row(n));
+  }
+  ///@}
+
+  //! multiple rows access
+  ///@{
+  ContiguousRef rows(std::size_t i, std::size_t j) {
+    return unit(MatrixRef<T, N>::rows(i, j));
+  }
+  ContiguousRef<const T, N> rows(std::size_t i, std::size_t j) const {
+    return unit(MatrixRef<T, N>::rows(i, j));
+  }
+  ///@}
+
+  //! multiple columns access
+  ///@{
+  ContiguousRef cols(std::size_t i, std::size_t j) {
+    return unit(MatrixRef<T, N>::cols(i, j));
+  }
+  ContiguousRef<const T, N> cols(std::size_t i, std::size_t j) const {
+    return unit(MatrixRef<T, N>::cols(i, j));
+  }
+  ///@}
+
+  //! element iterators, in logical order
+  ///@{
+  iterator begin() {
+    return matrix_impl::contiguous_iter<T, N>::make(this->desc_, this->data(),
+                                                    false);
+  }
+  const_iterator begin() const {
+    return matrix_impl::contiguous_iter<const T, N>::make(
+        this->desc_, this->data(), false);
+  }
+  iterator end() {
+    return matrix_impl::contiguous_iter<T, N>::make(this->desc_, this->data(),
+                                                    true);
+  }
+  const_iterator end() const {
+    return matrix_impl::contiguous_iter<const T, N>::make(
+        this->desc_, this->data(), true);
+  }
+  ///@}
+
+  //! f(x) for every element x
+  template <typename F> ContiguousRef &apply(F f) {
+    matrix_impl::for_each_line(this->desc_, this->data(), this->desc_,
+                               this->data(), [&](T *p, T *, std::size_t n) {
+                                 for (std::size_t k = 0; k != n; ++k)
+                                   f(p[k]);
+                               });
+    return *this;
+  }
+
+  //! f(x, mx) for corresponding elements of *this and m
+  template <typename M, typename F>
+  Enable_if<Matrix_type<M>(), ContiguousRef &> apply(const M &m, F f) {
+    assert(same_extents(this->desc_, m.descriptor()));
+    using U = const typename M::value_type;
+    if (Unit_stride<M>() || m.descriptor().strides[N - 1] == 1)
+      matrix_impl::for_each_line(this->desc_, this->data(), m.descriptor(),
+                                 m.data(), [&](T *p, U *q, std::size_t n) {
+                                   for (std::size_t k = 0; k != n; ++k)
+                                     f(p[k], q[k]);
+                                 });
+    else
+      MatrixRef<T, N>::apply(m, f);
+    return *this;
+  }
+
+private:
+  template <typename U, std::size_t M>
+  static Unit_view<U, M> unit(MatrixRef<U, M> r) {
+    return {r.descriptor(), r.data()};
+  }
+  template <typename U> static MatrixRef<U, 0> unit(MatrixRef<U, 0> r) {
+    return r;
+  }
+};
+
+// Walks a ContiguousRef of order N >= 2 in logical order: a pointer step
+// within a line, and the offset of the next line at its end
+template <typename T, std::size_t N> class ContiguousRefIterator {
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = typename std::remove_const<T>::type;
+  using difference_type = std::ptrdiff_t;
+  using pointer = T *;
+  using reference = T &;
+
+  ContiguousRefIterator(const MatrixSlice<N> &s, T *base, bool limit = false)
+      : desc_(s), base_(base), ptr_(base), line_(0),
+        lines_(matrix_impl::line_count(s)), left_(s.extents[N - 1]) {
+    if (limit || lines_ == 0)
+      line_ = lines_;
+    else
+      ptr_ += matrix_impl::line_offset(desc_, 0);
+  }
+
+  reference operator*() const { return *ptr_; }
+  pointer operator->() const { return ptr_; }
+
+  ContiguousRefIterator &operator++() {
+    ++ptr_;
+    if (--left_ == 0) {
+      left_ = desc_.extents[N - 1];
+      if (++line_ != lines_)
+        ptr_ = base_ + matrix_impl::line_offset(desc_, line_);
+    }
+    return *this;
+  }
+
+  ContiguousRefIterator operator++(int) {
+    ContiguousRefIterator tmp(*this);
+    ++*this;
+    return tmp;
+  }
+
+  bool operator==(const ContiguousRefIterator &x) const {
+    return line_ == x.line_ && left_ == x.left_;
+  }
+  bool operator!=(const ContiguousRefIterator &x) const {
+    return !(*this == x);
+  }
+
+private:
+  MatrixSlice<N> desc_;
+  T *base_;
+  T *ptr_;
+  std::size_t line_;  // current line, lines_ at the end
+  std::size_t lines_; // number of lines
+  std::size_t left_;  // elements left in the current line
+};
@@ -0,0 +1,416 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+// Reading delimited text files of numbers (CSV, TSV, ...) into a
+// Matrix<T, 2>, one row per line and one column per field.
+//
+// The file is read in blocks of whole lines. Each block is split into byte
+// ranges on line boundaries that the threads parse in parallel: a first
+// scan counts the rows of every range, so each thread knows where its rows
+// go, and a second one parses them into place. load_csv() counts the rows
+// of the whole file first and parses straight into a Matrix of the right
+// size, so the text is never held whole; stream_csv() hands the rows of each
+// block to a callback instead, in memory bounded by the block size.
+//
+// Numbers are parsed by hand: a float with at most 19 significant digits and
+// a small exponent is exactly the product or quotient of two doubles, which
+// are correctly rounded (Clinger's fast path); anything else goes through
+// strtod. Fields are not quoted. Blank lines are skipped. Empty fields,
+// fields missing at the end of a line and fields that are not numbers read
+// as NaN, or 0 for integer T; extra fields are ignored.
+
+namespace csv_impl {
+// Bytes read at a time, and bytes of a block one thread parses, at least
+constexpr std::size_t block_bytes = std::size_t(1) << 26;
+constexpr std::size_t grain = std::size_t(1) << 20;
+
+inline bool is_digit(char c) { return unsigned(c - '0') < 10; }
+
+// Call f(first, last) for every line of [p, e) that is not blank, without
+// its end of line
+template <typename F> void each_line(const char *p, const char *e, F f) {
+  while (p != e) {
+    const char *n = static_cast<const char *>(std::memchr(p, '\n', e - p));
+    const char *t = n ? n : e;
+    if (t != p && t[-1] == '\r')
+      --t;
+    if (t != p)
+      f(p, t);
+    p = n ? n + 1 : e;
+  }
+}
+
+// The start of the line after the one at p, or e
+inline const char *next_line(const char *p, const char *e) {
+  const char *n = static_cast<const char *>(std::memchr(p, '\n', e - p));
+  return n ? n + 1 : e;
+}
+
+// [first, last) split into at most one range of at least grain bytes per
+// thread, on line boundaries: range c is [b[c], b[c + 1])
+inline std::vector<const char *> ranges(const char *first, const char *last) {
+  const std::size_t n = last - first;
+  const std::size_t k = std::max<std::size_t>(
+      1, std::min(matrix_impl::thread_count(), n / grain));
+  std::vector<const char *> b(k + 1, last);
+  b[0] = first;
+  for (std::size_t c = 1; c != k; ++c) {
+    b[c] = next_line(std::max(first + n * c / k, b[c - 1]), last);
+  }
+  return b;
+}
+
+// [first, last) split into ranges, with the index of the first row of each
+// range within [first, last)
+struct layout {
+  std::vector<const char *> b; // range c is [b[c], b[c + 1])
+  std::vector<std::size_t> at; // at[c] rows before range c; at.back() in all
+
+  std::size_t rows() const { return at.back(); }
+};
+
+// The rows of every range counted in parallel
+inline layout lay_out(const char *first, const char *last) {
+  layout l{ranges(first, last), {}};
+  std::vector<std::size_t> rows(l.b.size() - 1, 0);
+  matrix_impl::parallel_tasks(rows.size(), [&](std::size_t c) {
+    each_line(l.b[c], l.b[c + 1],
+              [&](const char *, const char *) { ++rows[c]; });
+  });
+  l.at.assign(rows.size() + 1, 0);
+  for (std::size_t c = 0; c != rows.size(); ++c)
+    l.at[c + 1] = l.at[c] + rows[c];
+  return l;
+}
+
+// The fields of the line [p, e)
+inline std::size_t count_fields(const char *p, const char *e, char delim) {
+  return std::count(p, e, delim) + 1;
+}
+
+// 10^e exactly, for e in [0, 22]
+inline double exact_pow10(int e) {
+  static const double p[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                             1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                             1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                             1e18, 1e19, 1e20, 1e21, 1e22};
+  return p[e];
+}
+
+// The number at p, before e, into x when it has at most 19 significant
+// digits and its value is exactly m 10^k with m <= 2^53 and |k| <= 22;
+// returns the end of the number, or nullptr to leave it to strtod
+inline const char *fast_double(const char *p, const char *e, double &x) {
+  bool neg = false;
+  if (p != e && (*p == '-' || *p == '+'))
+    neg = *p++ == '-';
+  std::uint64_t m = 0;
+  int digits = 0, k = 0;
+  const char *s = p;
+  for (; p != e && is_digit(*p); ++p) {
+    if ((m != 0 || *p != '0') && ++digits > 19)
+      return nullptr;
+    m = m * 10 + (*p - '0');
+  }
+  bool any = p != s;
+  if (p != e && *p == '.') {
+    s = ++p;
+    for (; p != e && is_digit(*p); ++p, --k) {
+      if ((m != 0 || *p != '0') && ++digits > 19)
+        return nullptr;
+      m = m * 10 + (*p - '0');
+    }
+    any = any || p != s;
+  }
+  if (!any)
+    return nullptr;
+  if (p != e && (*p == 'e' || *p == 'E')) {
+    bool eneg = false;
+    if (++p != e && (*p == '-' || *p == '+'))
+      eneg = *p++ == '-';
+    int x = 0;
+    for (s = p; p != e && is_digit(*p) && x < 1000; ++p)
+      x = x * 10 + (*p - '0');
+    if (p == s)
+      return nullptr;
+    k += eneg ? -x : x;
+  }
+  if (m > std::uint64_t(1) << 53 || k < -22 || k > 22)
+    return nullptr;
+  x = k < 0 ? double(m) / exact_pow10(-k) : double(m) * exact_pow10(k);
+  if (neg)
+    x = -x;
+  return p;
+}
+
+// The fast path for other element types: a double rounded to float is the
+// float nearest the number, unless the double fell on a halfway point
+// between two floats (all the values it takes are normal floats)
+template <typename T>
+const char *fast_number(const char *p, const char *e, T &x,
+                        std::true_type /* floating */) {
+  double d;
+  p = fast_double(p, e, d);
+  if (!p)
+    return nullptr;
+  if (sizeof(T) < sizeof(double)) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &d, sizeof bits);
+    if ((bits & 0x1fffffff) == 0x10000000)
+      return nullptr;
+  }
+  x = T(d);
+  return p;
+}
+
+// integers: an optional sign and at most 18 digits, within the range of T
+template <typename T>
+const char *fast_number(const char *p, const char *e, T &x,
+                        std::false_type /* integral */) {
+  bool neg = false;
+  if (p != e && (*p == '-' || *p == '+'))
+    neg = *p++ == '-';
+  const char *s = p;
+  long long m = 0;
+  for (; p != e && is_digit(*p); ++p) {
+    if (p - s == 18)
+      return nullptr;
+    m = m * 10 + (*p - '0');
+  }
+  if (p == s)
+    return nullptr;
+  if (neg ? -m < (long long)std::numeric_limits<T>::lowest()
+          : (unsigned long long)m > std::numeric_limits<T>::max())
+    return nullptr;
+  x = T(neg ? -m : m);
+  return p;
+}
+
+inline double slow_number(const char *p, char **end, double) {
+  return std::strtod(p, end);
+}
+inline float slow_number(const char *p, char **end, float) {
+  return std::strtof(p, end);
+}
+inline long double slow_number(const char *p, char **end, long double) {
+  return std::strtold(p, end);
+}
+
+// What a field that is not a number reads as
+template <typename T> T missing() {
+  return std::numeric_limits<T>::has_quiet_NaN
+             ? std::numeric_limits<T>::quiet_NaN()
+             : T(0);
+}
+
+// The number [p, e), spaces trimmed, by strtod (clamped to the range of
+// an integer T)
+template <typename T> T slow_field(const char *p, const char *e) {
+  using F = typename std::conditional<std::is_floating_point<T>::value, T,
+                                      double>::type;
+  const std::string s(p, e);
+  char *end;
+  const F x = slow_number(s.c_str(), &end, F());
+  if (s.empty() || end != s.c_str() + s.size())
+    return missing<T>();
+  if (std::is_floating_point<T>::value)
+    return T(x);
+  if (x != x)
+    return T(0);
+  if (x <= F(std::numeric_limits<T>::lowest()))
+    return std::numeric_limits<T>::lowest();
+  if (x >= F(std::numeric_limits<T>::max()))
+    return std::numeric_limits<T>::max();
+  return T(x);
+}
+
+template <typename T> const char *number(const char *p, const char *e, T &x) {
+  return fast_number(p, e, x, std::is_floating_point<T>());
+}
+inline const char *number(const char *, const char *, long double &) {
+  return nullptr;
+}
+
+// The fields of the line [p, e) into out[0, cols)
+template <typename T>
+void parse_line(const char *p, const char *e, char delim, std::size_t cols,
+                T *out) {
+  const auto blank = [delim](char c) {
+    return c == ' ' || (c == '\t' && delim != '\t');
+  };
+  for (std::size_t j = 0; j != cols; ++j) {
+    while (p != e && blank(*p))
+      ++p;
+    const char *q = number(p, e, out[j]);
+    if (q)
+      while (q != e && blank(*q))
+        ++q;
+    if (q && (q == e || *q == delim)) {
+      p = q == e ? e : q + 1;
+      continue;
+    }
+    const char *t = static_cast<const char *>(std::memchr(p, delim, e - p));
+    const char *f = t ? t : e;
+    while (f != p && blank(f[-1]))
+      --f;
+    out[j] = slow_field<T>(p, f);
+    p = t ? t + 1 : e;
+  }
+}
+
+// The rows of l into out, cols elements per row, the ranges in parallel
+template <typename T>
+void parse_rows(const layout &l, char delim, std::size_t cols, T *out) {
+  matrix_impl::parallel_tasks(l.b.size() - 1, [&](std::size_t c) {
+    T *row = out + l.at[c] * cols;
+    each_line(l.b[c], l.b[c + 1], [&](const char *p, const char *e) {
+      parse_line(p, e, delim, cols, row);
+      row += cols;
+    });
+  });
+}
+
+// The columns of the first row of [first, last), 0 when it has none
+inline std::size_t first_row_fields(const char *first, const char *last,
+                                    char delim) {
+  std::size_t cols = 0;
+  each_line(first, last, [&](const char *p, const char *e) {
+    if (cols == 0)
+      cols = count_fields(p, e, delim);
+  });
+  return cols;
+}
+
+// Call f(first, last) on the file at path in blocks of whole lines of about
+// bytes bytes (more when a line is longer), after its first skip lines.
+// Throws std::runtime_error when the file cannot be opened or read.
+template <typename F>
+void for_blocks(const std::string &path, std::size_t skip, std::size_t bytes,
+                F f) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("csv: cannot open " + path);
+  std::vector<char> buf(std::max<std::size_t>(bytes, 1));
+  std::size_t fill = 0; // bytes in buf, the partial line left over first
+  bool eof = false;
+  while (!eof) {
+    in.read(buf.data() + fill, buf.size() - fill);
+    fill += in.gcount();
+    if (in.bad())
+      throw std::runtime_error("csv: cannot read " + path);
+    eof = !in;
+    const char *first = buf.data(), *last = buf.data() + fill;
+    if (!eof) {
+      const char *p = last;
+      while (p != first && p[-1] != '\n')
+        --p;
+      if (p == first) { // a line longer than buf
+        buf.resize(2 * buf.size());
+        continue;
+      }
+      last = p;
+    }
+    for (; skip != 0 && first != last; --skip)
+      first = next_line(first, last);
+    if (first != last)
+      f(first, last);
+    fill = buf.data() + fill - last;
+    std::copy(last, last + fill, buf.data());
+  }
+}
+} // namespace csv_impl
+
+//! The numbers in the file at path, one row per line and one column per
+//! field, fields separated by delim (',' for CSV, '\t' for TSV). The first
+//! skip lines, e.g. a header, are left out, as are blank lines. The number
+//! of columns is that of the first row. See the top of the file for the
+//! handling of odd fields. Throws std::runtime_error when the file cannot be
+//! read, or changes between the pass that counts its rows and the one that
+//! parses them.
+template <typename T>
+Matrix<T, 2> load_csv(const std::string &path, char delim = ',',
+                      std::size_t skip = 0) {
+  static_assert(std::is_arithmetic<T>::value, "load_csv: numbers only");
+  std::size_t rows = 0, cols = 0;
+  csv_impl::for_blocks(path, skip, csv_impl::block_bytes,
+                       [&](const char *first, const char *last) {
+                         if (cols == 0)
+                           cols = csv_impl::first_row_fields(first, last,
+                                                             delim);
+                         rows += csv_impl::lay_out(first, last).rows();
+                       });
+  Matrix<T, 2> m(rows, cols);
+  std::size_t row = 0;
+  csv_impl::for_blocks(path, skip, csv_impl::block_bytes,
+                       [&](const char *first, const char *last) {
+                         const csv_impl::layout l =
+                             csv_impl::lay_out(first, last);
+                         if (row + l.rows() > rows)
+                           throw std::runtime_error("load_csv: " + path +
+                                                    " changed while read");
+                         csv_impl::parse_rows(l, delim, cols,
+                                              m.data() + row * cols);
+                         row += l.rows();
+                       });
+  if (row != rows)
+    throw std::runtime_error("load_csv: " + path + " changed while read");
+  return m;
+}
+
+//! The numbers in text, as load_csv() reads them from a file
+template <typename T>
+Matrix<T, 2> parse_csv(const std::string &text, char delim = ',',
+                       std::size_t skip = 0) {
+  static_assert(std::is_arithmetic<T>::value, "parse_csv: numbers only");
+  const char *first = text.data(), *last = text.data() + text.size();
+  for (; skip != 0 && first != last; --skip)
+    first = csv_impl::next_line(first, last);
+  const csv_impl::layout l = csv_impl::lay_out(first, last);
+  const std::size_t cols = csv_impl::first_row_fields(first, last, delim);
+  Matrix<T, 2> m(l.rows(), cols);
+  csv_impl::parse_rows(l, delim, cols, m.data());
+  return m;
+}
+
+//! Read the file at path as load_csv() does, but a block of rows at a time:
+//! call f(rows, first_row) for consecutive blocks, rows being a
+//! MatrixRef<const T, 2> valid only during the call and first_row the index
+//! of its first row in the file. Only about block_bytes of text and the
+//! rows parsed from it are held at once. Returns the number of rows; throws
+//! std::runtime_error when the file cannot be read.
+template <typename T, typename F>
+std::size_t stream_csv(const std::string &path, F f, char delim = ',',
+                       std::size_t skip = 0,
+                       std::size_t block_bytes = csv_impl::block_bytes) {
+  static_assert(std::is_arithmetic<T>::value, "stream_csv: numbers only");
+  std::size_t rows = 0, cols = 0;
+  std::vector<T> block;
+  csv_impl::for_blocks(
+      path, skip, block_bytes, [&](const char *first, const char *last) {
+        if (cols == 0)
+          cols = csv_impl::first_row_fields(first, last, delim);
+        const csv_impl::layout l = csv_impl::lay_out(first, last);
+        if (l.rows() == 0)
+          return;
+        block.resize(l.rows() * cols);
+        csv_impl::parse_rows(l, delim, cols, block.data());
+        f(MatrixRef<const T, 2>(MatrixSlice<2>(l.rows(), cols), block.data()),
+          rows);
+        rows += l.rows();
+      });
+  return rows;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+// Runtime selection of the instruction set of the hot kernels. With GCC or
+// Clang on x86 every dispatched kernel is compiled once per level below, in
+// functions carrying a target attribute, and the level is picked on first
+// use from cpuid. The MATRIX_ISA environment variable (sse2, sse4.2, avx2,
+// avx512) lowers it; a level the CPU lacks is never selected. Elsewhere the
+// kernels only have their baseline version.
+
+//! instruction set levels the hot kernels are compiled for
+enum class isa {
+  sse2,   //!< x86-64 baseline
+  sse4_2, //!< Nehalem
+  avx2,   //!< AVX2 + FMA + F16C (Haswell, Zen)
+  avx512  //!< AVX-512 F/BW/VL/DQ (Skylake-X); VNNI when present
+};
+
+//! printable name of a level, as accepted by MATRIX_ISA
+inline const char *isa_name(isa level) {
+  static const char *const names[] = {"sse2", "sse4.2", "avx2", "avx512"};
+  return names[int(level)];
+}
+
+#if (defined(__GNUC__) || defined(__clang__)) &&                               \
+    (defined(__x86_64__) || defined(__i386__))
+#define MATRIX_DISPATCH 1
+#include <cpuid.h>
+#define MATRIX_TARGET_SSE4_2 __attribute__((target("sse4.2,popcnt")))
+#define MATRIX_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define MATRIX_TARGET_AVX512                                                   \
+  __attribute__((                                                              \
+      target("avx512f,avx512bw,avx512vl,avx512dq,avx2,fma,f16c")))
+#define MATRIX_TARGET_VNNI                                                     \
+  __attribute__((target("avx512f,avx512bw,avx512vl,avx512vnni")))
+// Body of a dispatched kernel: always inlined, so that it is compiled anew
+// inside every target-specific caller
+#define MATRIX_KERNEL inline __attribute__((always_inline))
+#else
+#define MATRIX_DISPATCH 0
+#define MATRIX_KERNEL inline
+#endif
+
+namespace matrix_impl {
+#if MATRIX_DISPATCH
+// F16C, which the avx2 and avx512 levels use for half conversions. Some VMs
+// mask it while exposing AVX2, and not every compiler knows it as a
+// __builtin_cpu_supports feature, so it is read from cpuid leaf 1.
+inline bool cpu_has_f16c() {
+  unsigned a, b, c, d;
+  return __get_cpuid(1, &a, &b, &c, &d) && (c & bit_F16C) != 0;
+}
+#endif
+
+// The best level this CPU (and OS) supports
+inline isa detect_isa() {
+#if MATRIX_DISPATCH
+  __builtin_cpu_init();
+  const bool f16c = cpu_has_f16c();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512vl") &&
+      __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx2") &&
+      __builtin_cpu_supports("fma") && f16c)
+    return isa::avx512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && f16c)
+    return isa::avx2;
+  if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+    return isa::sse4_2;
+#endif
+  return isa::sse2;
+}
+
+inline bool cpu_has_vnni() {
+#if MATRIX_DISPATCH
+  static const bool vnni = (__builtin_cpu_init(),
+                            __builtin_cpu_supports("avx512vnni") != 0);
+  return vnni;
+#else
+  return false;
+#endif
+}
+
+// Parse a level name; false when s names none
+inline bool parse_isa(const char *s, isa &level) {
+  for (int i = 0; i != 4; ++i)
+    if (std::strcmp(s, isa_name(isa(i))) == 0) {
+      level = isa(i);
+      return true;
+    }
+  return false;
+}
+
+// The level in use: detected once, lowered by MATRIX_ISA
+inline std::atomic<isa> &isa_level() {
+  static std::atomic<isa> level{[] {
+    isa l = detect_isa(), wanted;
+    const char *env = std::getenv("MATRIX_ISA");
+    if (env && parse_isa(env, wanted) && wanted < l)
+      l = wanted;
+    return l;
+  }()};
+  return level;
+}
+
+#if MATRIX_DISPATCH
+template <typename K, typename... Args>
+MATRIX_TARGET_SSE4_2 auto run_sse4_2(Args... args)
+    -> decltype(K::run(args...)) {
+  return K::run(args...);
+}
+
+template <typename K, typename... Args>
+MATRIX_TARGET_AVX2 auto run_avx2(Args... args) -> decltype(K::run(args...)) {
+  return K::run(args...);
+}
+
+template <typename K, typename... Args>
+MATRIX_TARGET_AVX512 auto run_avx512(Args... args)
+    -> decltype(K::run(args...)) {
+  return K::run(args...);
+}
+#endif
+
+// K::run(args...) compiled for the active level. K::run must be a
+// MATRIX_KERNEL and should not call anything too large to be inlined, or
+// that part runs at the baseline level.
+template <typename K, typename... Args>
+auto dispatch(Args... args) -> decltype(K::run(args...)) {
+#if MATRIX_DISPATCH
+  switch (isa_level().load(std::memory_order_relaxed)) {
+  case isa::avx512:
+    return run_avx512<K>(args...);
+  case isa::avx2:
+    return run_avx2<K>(args...);
+  case isa::sse4_2:
+    return run_sse4_2<K>(args...);
+  default:
+    break;
+  }
+#endif
+  return K::run(args...);
+}
+} // namespace matrix_impl
+
+//! the instruction set level the hot kernels run with
+inline isa active_isa() { return matrix_impl::isa_level(); }
+
+//! the best level this CPU supports
+inline isa detected_isa() {
+  static const isa level = matrix_impl::detect_isa();
+  return level;
+}
+
+//! Select the level of the hot kernels, e.g. to compare them. It is clamped
+//! to detected_isa(). Kernels already running keep their level.
+inline void set_isa(isa level) {
+  matrix_impl::isa_level() = level < detected_isa() ? level : detected_isa();
+}
@@ -0,0 +1,479 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+// Discrete Fourier transforms along one axis of a Matrix or view of any
+// order and strides: fft/ifft of complex or real elements, rfft of real
+// elements (the n / 2 + 1 non-redundant outputs) and its inverse irfft.
+//
+// A transform of length n follows a plan: n split into radix-4, radix-2 and
+// then odd prime passes, with their twiddle factors. Plans are made once per
+// length and element type and cached. The passes are Stockham's self-sorting
+// ones, so there is no bit-reversal step and any length works; a large prime
+// factor p costs O(n p) though, so lengths with small factors are fastest.
+//
+// The lines along the axis are transformed in batches: each batch is
+// gathered into separate real and imaginary arrays with the line index
+// varying fastest, so that every pass runs unit-stride loops over the whole
+// batch. Batches are split between the threads. Real transforms of even
+// length run as complex transforms of half the length.
+
+namespace fft_impl {
+// The real type the transform of V is computed in
+template <typename V> struct real_of {
+  using type = typename std::conditional<std::is_floating_point<V>::value, V,
+                                         double>::type;
+};
+template <typename U> struct real_of<std::complex<U>> { using type = U; };
+template <typename V> using Real = typename real_of<V>::type;
+
+template <typename V> struct is_complex : std::false_type {};
+template <typename U> struct is_complex<std::complex<U>> : std::true_type {};
+
+template <typename M>
+using Value = typename std::remove_const<typename M::value_type>::type;
+
+constexpr double two_pi = 6.283185307179586476925286766559;
+
+// Lines per batch, at least (for a strided axis, a gathered cache line of
+// input then feeds a whole batch) and at most; complex elements per batch to
+// aim for between the two; and elements per parallel task
+constexpr std::size_t min_batch = 8;
+constexpr std::size_t max_batch = 16;
+constexpr std::size_t batch_elems = 8192;
+constexpr std::size_t grain = 32768;
+
+// A complex transform of length n on b interleaved sequences: element t of
+// sequence s at [t * b + s] of separate real and imaginary arrays
+template <typename T> class plan {
+public:
+  explicit plan(std::size_t n) : n_(n) {
+    assert(n >= 1);
+    std::size_t rest = n;
+    while (rest % 4 == 0) {
+      add_stage(4, rest);
+      rest /= 4;
+    }
+    while (rest % 2 == 0) {
+      add_stage(2, rest);
+      rest /= 2;
+    }
+    for (std::size_t p = 3; rest > 1; p += 2)
+      while (rest % p == 0) {
+        add_stage(p, rest);
+        rest /= p;
+      }
+  }
+
+  std::size_t size() const { return n_; }
+
+  // Forward transform in place; (wr, wi) is scratch of the same size
+  void run(T *re, T *im, T *wr, T *wi, std::size_t b) const {
+    T *xr = re, *xi = im, *yr = wr, *yi = wi;
+    std::size_t len = b; // s * b, s being the product of the radices so far
+    for (const stage &st : stages_) {
+      const T *tr = tw_re_.data() + st.tw, *ti = tw_im_.data() + st.tw;
+      switch (st.radix) {
+      case 2:
+        pass2(st.m, len, tr, ti, xr, xi, yr, yi);
+        break;
+      case 4:
+        pass4(st.m, len, tr, ti, xr, xi, yr, yi);
+        break;
+      default:
+        pass_any(st.radix, st.m, len, tr, ti, tw_re_.data() + st.roots,
+                 tw_im_.data() + st.roots, xr, xi, yr, yi);
+      }
+      std::swap(xr, yr);
+      std::swap(xi, yi);
+      len *= st.radix;
+    }
+    if (xr != re) {
+      std::copy(xr, xr + n_ * b, re);
+      std::copy(xi, xi + n_ * b, im);
+    }
+  }
+
+private:
+  // A pass of radix p over sequences of length p * m, with the twiddle
+  // factor w^(j k) of output k of butterfly j at [tw + j * p + k], and for
+  // the generic butterfly the p-th roots of unity at [roots]
+  struct stage {
+    std::size_t radix, m, tw, roots;
+  };
+
+  void add_stage(std::size_t p, std::size_t len) {
+    stage st{p, len / p, tw_re_.size(), 0};
+    for (std::size_t j = 0; j != st.m; ++j)
+      for (std::size_t k = 0; k != p; ++k)
+        add_root(j * k % len, len);
+    st.roots = tw_re_.size();
+    if (p != 2 && p != 4)
+      for (std::size_t k = 0; k != p; ++k)
+        add_root(k, p);
+    stages_.push_back(st);
+  }
+
+  // exp(-2 pi i k / n), computed in double
+  void add_root(std::size_t k, std::size_t n) {
+    const double a = -two_pi * double(k) / double(n);
+    tw_re_.push_back(T(std::cos(a)));
+    tw_im_.push_back(T(std::sin(a)));
+  }
+
+  // Output k of butterfly j of x goes to y[(p j + k) len + c], its input r
+  // is x[(j + r m) len + c], for c in [0, len)
+  static void pass2(std::size_t m, std::size_t len, const T *tr, const T *ti,
+                    const T *xr, const T *xi, T *yr, T *yi) {
+    for (std::size_t j = 0; j != m; ++j) {
+      const T wr = tr[2 * j + 1], wi = ti[2 * j + 1];
+      const T *ar = xr + j * len, *ai = xi + j * len;
+      const T *br = ar + m * len, *bi = ai + m * len;
+      T *y0r = yr + 2 * j * len, *y0i = yi + 2 * j * len;
+      T *y1r = y0r + len, *y1i = y0i + len;
+      for (std::size_t c = 0; c != len; ++c) {
+        const T dr = ar[c] - br[c], di = ai[c] - bi[c];
+        y0r[c] = ar[c] + br[c];
+        y0i[c] = ai[c] + bi[c];
+        y1r[c] = dr * wr - di * wi;
+        y1i[c] = dr * wi + di * wr;
+      }
+    }
+  }
+
+  static void pass4(std::size_t m, std::size_t len, const T *tr, const T *ti,
+                    const T *xr, const T *xi, T *yr, T *yi) {
+    const std::size_t q = m * len;
+    for (std::size_t j = 0; j != m; ++j) {
+      const T *w_r = tr + 4 * j, *w_i = ti + 4 * j;
+      const T *ar = xr + j * len, *ai = xi + j * len;
+      T *y0r = yr + 4 * j * len, *y0i = yi + 4 * j * len;
+      for (std::size_t c = 0; c != len; ++c) {
+        // a0 + a2, a0 - a2, a1 + a3 and -i (a1 - a3)
+        const T s0r = ar[c] + ar[c + 2 * q], s0i = ai[c] + ai[c + 2 * q];
+        const T d0r = ar[c] - ar[c + 2 * q], d0i = ai[c] - ai[c + 2 * q];
+        const T s1r = ar[c + q] + ar[c + 3 * q];
+        const T s1i = ai[c + q] + ai[c + 3 * q];
+        const T d1r = ai[c + q] - ai[c + 3 * q];
+        const T d1i = ar[c + 3 * q] - ar[c + q];
+        y0r[c] = s0r + s1r;
+        y0i[c] = s0i + s1i;
+        const T z1r = d0r + d1r, z1i = d0i + d1i;
+        const T z2r = s0r - s1r, z2i = s0i - s1i;
+        const T z3r = d0r - d1r, z3i = d0i - d1i;
+        y0r[c + len] = z1r * w_r[1] - z1i * w_i[1];
+        y0i[c + len] = z1r * w_i[1] + z1i * w_r[1];
+        y0r[c + 2 * len] = z2r * w_r[2] - z2i * w_i[2];
+        y0i[c + 2 * len] = z2r * w_i[2] + z2i * w_r[2];
+        y0r[c + 3 * len] = z3r * w_r[3] - z3i * w_i[3];
+        y0i[c + 3 * len] = z3r * w_i[3] + z3i * w_r[3];
+      }
+    }
+  }
+
+  // Any radix p, as a direct DFT of p points: O(p^2) per butterfly
+  static void pass_any(std::size_t p, std::size_t m, std::size_t len,
+                       const T *tr, const T *ti, const T *rr, const T *ri,
+                       const T *xr, const T *xi, T *yr, T *yi) {
+    const std::size_t q = m * len;
+    for (std::size_t j = 0; j != m; ++j) {
+      const T *ar = xr + j * len, *ai = xi + j * len;
+      for (std::size_t k = 0; k != p; ++k) {
+        T *y_r = yr + (p * j + k) * len, *y_i = yi + (p * j + k) * len;
+        std::fill(y_r, y_r + len, T(0));
+        std::fill(y_i, y_i + len, T(0));
+        for (std::size_t r = 0; r != p; ++r) {
+          const T wr = rr[r * k % p], wi = ri[r * k % p];
+          const T *a_r = ar + r * q, *a_i = ai + r * q;
+          for (std::size_t c = 0; c != len; ++c) {
+            y_r[c] += a_r[c] * wr - a_i[c] * wi;
+            y_i[c] += a_r[c] * wi + a_i[c] * wr;
+          }
+        }
+        const T wr = tr[p * j + k], wi = ti[p * j + k];
+        for (std::size_t c = 0; c != len; ++c) {
+          const T zr = y_r[c];
+          y_r[c] = zr * wr - y_i[c] * wi;
+          y_i[c] = zr * wi + y_i[c] * wr;
+        }
+      }
+    }
+  }
+
+  std::size_t n_;
+  std::vector<stage> stages_;
+  std::vector<T> tw_re_, tw_im_; // twiddle factors and roots of all stages
+};
+
+// A real transform of even length n: a complex plan of length n / 2 and
+// the factors exp(-2 pi i k / n), k in [0, n / 2), that untangle its output
+template <typename T> struct real_plan {
+  explicit real_plan(std::size_t n) : half(n / 2), wr(n / 2), wi(n / 2) {
+    assert(n % 2 == 0);
+    for (std::size_t k = 0; k != n / 2; ++k) {
+      const double a = -two_pi * double(k) / double(n);
+      wr[k] = T(std::cos(a));
+      wi[k] = T(std::sin(a));
+    }
+  }
+
+  plan<T> half;
+  std::vector<T> wr, wi;
+};
+
+// The P(n) made by the first request for length n, shared by all threads
+template <typename P> std::shared_ptr<const P> cached(std::size_t n) {
+  static std::mutex m;
+  static std::map<std::size_t, std::shared_ptr<const P>> plans;
+  std::lock_guard<std::mutex> lock(m);
+  std::shared_ptr<const P> &p = plans[n];
+  if (!p)
+    p = std::make_shared<const P>(n);
+  return p;
+}
+
+template <typename T, typename U>
+void split(const std::complex<U> &x, T &re, T &im) {
+  re = T(x.real());
+  im = T(x.imag());
+}
+template <typename T, typename U> void split(const U &x, T &re, T &im) {
+  re = T(x);
+  im = T(0);
+}
+
+// Call f(in, out, b, scratch) for batches of b lines along the last
+// dimension of d and od, split between the threads: in[s] and out[s] are
+// the offsets of the first elements of line s of the batch in d and od, and
+// the scratch has room for 4 n b elements, n being the plan length
+template <typename T, std::size_t N, typename F>
+void batched(const MatrixSlice<N> &d, const MatrixSlice<N> &od, std::size_t n,
+             F f) {
+  const std::size_t batch =
+      std::max(min_batch, std::min(max_batch, batch_elems / n));
+  matrix_impl::parallel_for(
+      0, matrix_impl::line_count(d), std::max<std::size_t>(1, grain / n),
+      [&](std::size_t first, std::size_t last) {
+        std::vector<T> buf(4 * n * batch);
+        std::size_t in[max_batch], out[max_batch];
+        for (std::size_t l = first; l < last; l += batch) {
+          const std::size_t b = std::min(batch, last - l);
+          for (std::size_t s = 0; s != b; ++s) {
+            in[s] = matrix_impl::line_offset(d, l + s);
+            out[s] = matrix_impl::line_offset(od, l + s);
+          }
+          f(in, out, b, buf.data());
+        }
+      });
+}
+
+// The complex transform along axis of m, inverse (conjugated and scaled by
+// 1 / n) when inverse is set
+template <typename T, typename M>
+Matrix<std::complex<T>, M::order()> complex_fft(const M &m, std::size_t axis,
+                                               bool inverse) {
+  constexpr std::size_t N = M::order();
+  const MatrixSlice<N> d = matrix_impl::axis_last(m.descriptor(), axis);
+  Matrix<std::complex<T>, N> out(m.descriptor().extents);
+  const MatrixSlice<N> od = matrix_impl::axis_last(out.descriptor(), axis);
+  const std::size_t n = d.extents[N - 1], lines = matrix_impl::line_count(d);
+  if (lines == 0)
+    return out;
+  const std::shared_ptr<const plan<T>> p = cached<plan<T>>(n);
+  const std::size_t st = d.strides[N - 1], ost = od.strides[N - 1];
+  const Value<M> *src = m.data();
+  std::complex<T> *dst = out.data();
+  const T sign = inverse ? T(-1) : T(1), scale = inverse ? T(1) / T(n) : T(1);
+
+  batched<T>(d, od, n, [&](const std::size_t *in, const std::size_t *to,
+                            std::size_t b, T *buf) {
+    T *re = buf, *im = buf + n * b;
+    for (std::size_t t = 0; t != n; ++t)
+      for (std::size_t s = 0; s != b; ++s) {
+        split(src[in[s] + t * st], re[t * b + s], im[t * b + s]);
+        im[t * b + s] *= sign;
+      }
+    p->run(re, im, buf + 2 * n * b, buf + 3 * n * b, b);
+    for (std::size_t t = 0; t != n; ++t)
+      for (std::size_t s = 0; s != b; ++s)
+        dst[to[s] + t * ost] = std::complex<T>(re[t * b + s] * scale,
+                                               sign * im[t * b + s] * scale);
+  });
+  return out;
+}
+
+// m's extents with extent n along axis
+template <std::size_t N>
+std::array<std::size_t, N> with_extent(const MatrixSlice<N> &d,
+                                       std::size_t axis, std::size_t n) {
+  std::array<std::size_t, N> e = d.extents;
+  e[axis] = n;
+  return e;
+}
+} // namespace fft_impl
+
+//! The discrete Fourier transform of every line along axis (the last one by
+//! default) of m, whose elements are complex or real: out[k] = sum over t of
+//! m[t] exp(-2 pi i t k / n), with n = m.extent(axis)
+template <typename M>
+Enable_if<Matrix_type<M>(),
+          Matrix<std::complex<fft_impl::Real<fft_impl::Value<M>>>, M::order()>>
+fft(const M &m, std::size_t axis = M::order() - 1) {
+  using T = fft_impl::Real<fft_impl::Value<M>>;
+  return fft_impl::complex_fft<T>(m, axis, false);
+}
+
+//! The inverse of fft: out[t] = 1 / n sum over k of m[k] exp(2 pi i t k / n)
+template <typename M>
+Enable_if<Matrix_type<M>(),
+          Matrix<std::complex<fft_impl::Real<fft_impl::Value<M>>>, M::order()>>
+ifft(const M &m, std::size_t axis = M::order() - 1) {
+  using T = fft_impl::Real<fft_impl::Value<M>>;
+  return fft_impl::complex_fft<T>(m, axis, true);
+}
+
+//! The fft of real m along axis, without its redundant half: elements
+//! [0, n / 2] of every line, the others being their complex conjugates
+//! (none for n = 0)
+template <typename M>
+Enable_if<Matrix_type<M>(),
+          Matrix<std::complex<fft_impl::Real<fft_impl::Value<M>>>, M::order()>>
+rfft(const M &m, std::size_t axis = M::order() - 1) {
+  using T = fft_impl::Real<fft_impl::Value<M>>;
+  constexpr std::size_t N = M::order();
+  static_assert(!fft_impl::is_complex<fft_impl::Value<M>>::value,
+                "rfft: the elements must be real");
+  const MatrixSlice<N> d = matrix_impl::axis_last(m.descriptor(), axis);
+  const std::size_t n = d.extents[N - 1], h = n / 2;
+  if (n == 0) // nothing to transform: extent 0, as fft gives
+    return Matrix<std::complex<T>, N>(
+        fft_impl::with_extent(m.descriptor(), axis, 0));
+  if (n % 2 != 0) { // no half-length trick: keep half of the full transform
+    Matrix<std::complex<T>, N> full = fft_impl::complex_fft<T>(m, axis, false);
+    MatrixSlice<N> kd = full.descriptor();
+    kd.extents[axis] = h + 1;
+    kd.size = matrix_impl::compute_size(kd.extents);
+    return Matrix<std::complex<T>, N>(
+        MatrixRef<std::complex<T>, N>(kd, full.data()));
+  }
+  Matrix<std::complex<T>, N> out(
+      fft_impl::with_extent(m.descriptor(), axis, h + 1));
+  const MatrixSlice<N> od = matrix_impl::axis_last(out.descriptor(), axis);
+  if (matrix_impl::line_count(d) == 0)
+    return out;
+  const auto p = fft_impl::cached<fft_impl::real_plan<T>>(n);
+  const std::size_t st = d.strides[N - 1], ost = od.strides[N - 1];
+  const fft_impl::Value<M> *src = m.data();
+  std::complex<T> *dst = out.data();
+
+  fft_impl::batched<T>(d, od, h, [&](const std::size_t *in,
+                                     const std::size_t *to, std::size_t b,
+                                     T *buf) {
+    // z[t] = x[2 t] + i x[2 t + 1], whose transform Z untangles into
+    // X[k] = (Z[k] + conj Z[h - k]) / 2 - i w^k (Z[k] - conj Z[h - k]) / 2
+    T *re = buf, *im = buf + h * b;
+    for (std::size_t t = 0; t != h; ++t)
+      for (std::size_t s = 0; s != b; ++s) {
+        re[t * b + s] = T(src[in[s] + 2 * t * st]);
+        im[t * b + s] = T(src[in[s] + (2 * t + 1) * st]);
+      }
+    p->half.run(re, im, buf + 2 * h * b, buf + 3 * h * b, b);
+    for (std::size_t k = 0; k <= h; ++k) {
+      const T wr = k == h ? T(-1) : p->wr[k], wi = k == h ? T(0) : p->wi[k];
+      const T *ar = re + (k % h) * b, *ai = im + (k % h) * b;
+      const T *cr = re + (h - k) % h * b, *ci = im + (h - k) % h * b;
+      for (std::size_t s = 0; s != b; ++s) {
+        const T er = (ar[s] + cr[s]) / 2, ei = (ai[s] - ci[s]) / 2;
+        const T or_ = (ai[s] + ci[s]) / 2, oi = (cr[s] - ar[s]) / 2;
+        dst[to[s] + k * ost] =
+            std::complex<T>(er + or_ * wr - oi * wi, ei + or_ * wi + oi * wr);
+      }
+    }
+  });
+  return out;
+}
+
+//! The inverse of rfft: the real lines of length n along axis whose rfft is
+//! m, so m.extent(axis) must be n / 2 + 1
+template <typename M>
+Enable_if<Matrix_type<M>(),
+          Matrix<fft_impl::Real<fft_impl::Value<M>>, M::order()>>
+irfft(const M &m, std::size_t n, std::size_t axis = M::order() - 1) {
+  using T = fft_impl::Real<fft_impl::Value<M>>;
+  constexpr std::size_t N = M::order();
+  const MatrixSlice<N> d = matrix_impl::axis_last(m.descriptor(), axis);
+  assert(n >= 1 && d.extents[N - 1] == n / 2 + 1);
+  Matrix<T, N> out(fft_impl::with_extent(m.descriptor(), axis, n));
+  const MatrixSlice<N> od = matrix_impl::axis_last(out.descriptor(), axis);
+  if (matrix_impl::line_count(od) == 0)
+    return out;
+  const std::size_t st = d.strides[N - 1], ost = od.strides[N - 1];
+  const fft_impl::Value<M> *src = m.data();
+  T *dst = out.data();
+
+  if (n % 2 != 0) { // rebuild the conjugate half, then a full inverse
+    const auto p = fft_impl::cached<fft_impl::plan<T>>(n);
+    fft_impl::batched<T>(d, od, n, [&](const std::size_t *in,
+                                       const std::size_t *to, std::size_t b,
+                                       T *buf) {
+      T *re = buf, *im = buf + n * b;
+      for (std::size_t k = 0; k != n; ++k) {
+        const std::size_t j = k <= n / 2 ? k : n - k;
+        // conjugated for the inverse, twice for the rebuilt half
+        const T sign = k <= n / 2 ? T(-1) : T(1);
+        for (std::size_t s = 0; s != b; ++s) {
+          fft_impl::split(src[in[s] + j * st], re[k * b + s], im[k * b + s]);
+          im[k * b + s] *= sign;
+        }
+      }
+      p->run(re, im, buf + 2 * n * b, buf + 3 * n * b, b);
+      for (std::size_t t = 0; t != n; ++t)
+        for (std::size_t s = 0; s != b; ++s)
+          dst[to[s] + t * ost] = re[t * b + s] / T(n);
+    });
+    return out;
+  }
+
+  const std::size_t h = n / 2;
+  const auto p = fft_impl::cached<fft_impl::real_plan<T>>(n);
+  fft_impl::batched<T>(d, od, h, [&](const std::size_t *in,
+                                     const std::size_t *to, std::size_t b,
+                                     T *buf) {
+    // Z[k] = E[k] + i O[k], with E[k] = (X[k] + conj X[h - k]) / 2 and
+    // O[k] = (X[k] - conj X[h - k]) conj(w^k) / 2, transformed back
+    T *re = buf, *im = buf + h * b;
+    for (std::size_t k = 0; k != h; ++k) {
+      const T wr = p->wr[k], wi = -p->wi[k];
+      for (std::size_t s = 0; s != b; ++s) {
+        T ar, ai, cr, ci;
+        fft_impl::split(src[in[s] + k * st], ar, ai);
+        fft_impl::split(src[in[s] + (h - k) * st], cr, ci);
+        const T er = (ar + cr) / 2, ei = (ai - ci) / 2;
+        const T dr = (ar - cr) / 2, di = (ai + ci) / 2;
+        const T or_ = dr * wr - di * wi, oi = dr * wi + di * wr;
+        // conjugated, for an inverse through the forward plan
+        re[k * b + s] = er - oi;
+        im[k * b + s] = -(ei + or_);
+      }
+    }
+    p->half.run(re, im, buf + 2 * h * b, buf + 3 * h * b, b);
+    for (std::size_t t = 0; t != h; ++t)
+      for (std::size_t s = 0; s != b; ++s) {
+        dst[to[s] + 2 * t * ost] = re[t * b + s] / T(h);
+        dst[to[s] + (2 * t + 1) * ost] = -im[t * b + s] / T(h);
+      }
+  });
+  return out;
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+
+#include "dispatch.hpp"
+#include "matrix_impl.hpp"
+
+#if MATRIX_DISPATCH
+#include <immintrin.h>
+#endif
+
+// Reduced precision storage types. They only store; every operation converts
+// them to float, so Matrix<half, N> and Matrix<bfloat16, N> halve the memory
+// traffic of Matrix<float, N> while computing and accumulating in float.
+
+namespace matrix_impl {
+// IEEE binary32 <-> binary16, round to nearest even, with infinities, NaNs
+// and subnormals (F. Giesen's branch-light conversions)
+inline float half_to_float(std::uint16_t h) {
+  const std::uint32_t shifted_exp = 0x7c00u << 13;
+  std::uint32_t u = std::uint32_t(h & 0x7fff) << 13;
+  const std::uint32_t exp = shifted_exp & u;
+  u += (127 - 15) << 23;
+  float f;
+  if (exp == shifted_exp) { // Inf / NaN
+    u += (128 - 16) << 23;
+  } else if (exp == 0) { // zero / subnormal: renormalize
+    const std::uint32_t magic_bits = 113u << 23;
+    float magic;
+    std::memcpy(&magic, &magic_bits, 4);
+    u += 1 << 23;
+    std::memcpy(&f, &u, 4);
+    f -= magic;
+    std::memcpy(&u, &f, 4);
+  }
+  u |= std::uint32_t(h & 0x8000) << 16;
+  std::memcpy(&f, &u, 4);
+  return f;
+}
+
+inline std::uint16_t float_to_half(float f) {
+  std::uint32_t u;
+  std::memcpy(&u, &f, 4);
+  const std::uint32_t sign = u & 0x80000000u;
+  u ^= sign;
+
+  std::uint16_t h;
+  if (u >= (127u + 16) << 23) { // too large: Inf, or NaN kept quiet
+    h = u > 255u << 23 ? 0x7e00 : 0x7c00;
+  } else if (u < 113u << 23) { // subnormal or zero
+    // adding 0.5 aligns the 10 mantissa bits at the bottom of the float,
+    // and the FPU rounds them to nearest even
+    const std::uint32_t magic_bits = 126u << 23;
+    float magic, g;
+    std::memcpy(&magic, &magic_bits, 4);
+    std::memcpy(&g, &u, 4);
+    g += magic;
+    std::memcpy(&u, &g, 4);
+    h = std::uint16_t(u - magic_bits);
+  } else {
+    const std::uint32_t mant_odd = (u >> 13) & 1;
+    u += ((15u - 127u) << 23) + 0xfff + mant_odd; // rebias and round
+    h = std::uint16_t(u >> 13);
+  }
+  return std::uint16_t(h | (sign >> 16));
+}
+
+// bfloat16 is the upper half of a binary32
+inline float bfloat16_to_float(std::uint16_t b) {
+  const std::uint32_t u = std::uint32_t(b) << 16;
+  float f;
+  std::memcpy(&f, &u, 4);
+  return f;
+}
+
+inline std::uint16_t float_to_bfloat16(float f) {
+  std::uint32_t u;
+  std::memcpy(&u, &f, 4);
+  if ((u & 0x7fffffffu) > 0x7f800000u) // NaN: keep it quiet
+    return std::uint16_t((u >> 16) | 0x40);
+  u += 0x7fff + ((u >> 16) & 1); // round to nearest even
+  return std::uint16_t(u >> 16);
+}
+} // namespace matrix_impl
+
+//! IEEE 754 binary16
+struct half {
+  std::uint16_t bits;
+
+  half() = default;
+  half(float f) : bits{matrix_impl::float_to_half(f)} {}
+  operator float() const { return matrix_impl::half_to_float(bits); }
+
+  static half from_bits(std::uint16_t b) {
+    half h;
+    h.bits = b;
+    return h;
+  }
+};
+
+//! bfloat16: binary32 with the mantissa cut to 7 bits
+struct bfloat16 {
+  std::uint16_t bits;
+
+  bfloat16() = default;
+  bfloat16(float f) : bits{matrix_impl::float_to_bfloat16(f)} {}
+  operator float() const { return matrix_impl::bfloat16_to_float(bits); }
+
+  static bfloat16 from_bits(std::uint16_t b) {
+    bfloat16 h;
+    h.bits = b;
+    return h;
+  }
+};
+
+inline std::ostream &operator<<(std::ostream &os, half h) {
+  return os << float(h);
+}
+
+inline std::ostream &operator<<(std::ostream &os, bfloat16 b) {
+  return os << float(b);
+}
+
+//! arithmetic on the reduced types is done, and accumulated, in float
+///@{
+template <> struct accumulator<half> { using type = float; };
+template <> struct accumulator<bfloat16> { using type = float; };
+///@}
+
+namespace matrix_impl {
+// Vectorized conversions between float and the reduced types, picked at run
+// time: AVX-512 or F16C for half, and for bfloat16 the plain bit
+// manipulations compiled for the active level. Every copy between matrices
+// of these element types ends up here through blocked_copy. The
+// target-specific loops return how many elements they converted.
+#if MATRIX_DISPATCH
+MATRIX_TARGET_AVX512 inline std::size_t
+half_to_float_avx512(const half *s, float *d, std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(
+        d + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(s + i))));
+  return i;
+}
+
+MATRIX_TARGET_AVX2 inline std::size_t half_to_float_f16c(const half *s,
+                                                         float *d,
+                                                         std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(
+        d + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(s + i))));
+  return i;
+}
+
+MATRIX_TARGET_AVX512 inline std::size_t
+float_to_half_avx512(const float *s, half *d, std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    _mm256_storeu_si256(
+        (__m256i *)(d + i),
+        _mm512_cvtps_ph(_mm512_loadu_ps(s + i), _MM_FROUND_TO_NEAREST_INT));
+  return i;
+}
+
+MATRIX_TARGET_AVX2 inline std::size_t float_to_half_f16c(const float *s,
+                                                         half *d,
+                                                         std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm_storeu_si128(
+        (__m128i *)(d + i),
+        _mm256_cvtps_ph(_mm256_loadu_ps(s + i), _MM_FROUND_TO_NEAREST_INT));
+  return i;
+}
+#endif
+
+template <> struct convert_n<half, float> {
+  static void run(const half *s, float *d, std::size_t n) {
+    std::size_t i = 0;
+#if MATRIX_DISPATCH
+    const isa level = isa_level().load(std::memory_order_relaxed);
+    if (level >= isa::avx512)
+      i = half_to_float_avx512(s, d, n);
+    else if (level >= isa::avx2)
+      i = half_to_float_f16c(s, d, n);
+#endif
+    for (; i != n; ++i)
+      d[i] = half_to_float(s[i].bits);
+  }
+};
+
+template <> struct convert_n<float, half> {
+  static void run(const float *s, half *d, std::size_t n) {
+    std::size_t i = 0;
+#if MATRIX_DISPATCH
+    const isa level = isa_level().load(std::memory_order_relaxed);
+    if (level >= isa::avx512)
+      i = float_to_half_avx512(s, d, n);
+    else if (level >= isa::avx2)
+      i = float_to_half_f16c(s, d, n);
+#endif
+    for (; i != n; ++i)
+      d[i].bits = float_to_half(s[i]);
+  }
+};
+
+// Branch-free forms of bfloat16_to_float and float_to_bfloat16, which the
+// compiler vectorizes at every level
+struct widen_bfloat16_kernel {
+  static MATRIX_KERNEL void run(const bfloat16 *s, float *d, std::size_t n) {
+    for (std::size_t i = 0; i != n; ++i) {
+      const std::uint32_t u = std::uint32_t(s[i].bits) << 16;
+      std::memcpy(d + i, &u, 4);
+    }
+  }
+};
+
+struct narrow_bfloat16_kernel {
+  static MATRIX_KERNEL void run(const float *s, bfloat16 *d, std::size_t n) {
+    for (std::size_t i = 0; i != n; ++i) {
+      std::uint32_t u;
+      std::memcpy(&u, s + i, 4);
+      const std::uint32_t nan = (u >> 16) | 0x40;
+      const std::uint32_t rounded = (u + 0x7fff + ((u >> 16) & 1)) >> 16;
+      const bool is_nan = (u & 0x7fffffffu) > 0x7f800000u;
+      d[i].bits = std::uint16_t(is_nan ? nan : rounded);
+    }
+  }
+};
+
+template <> struct convert_n<bfloat16, float> {
+  static void run(const bfloat16 *s, float *d, std::size_t n) {
+    dispatch<widen_bfloat16_kernel>(s, d, n);
+  }
+};
+
+template <> struct convert_n<float, bfloat16> {
+  static void run(const float *s, bfloat16 *d, std::size_t n) {
+    dispatch<narrow_bfloat16_kernel>(s, d, n);
+  }
+};
+} // namespace matrix_impl
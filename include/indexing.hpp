@@ -0,0 +1,309 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "dispatch.hpp"
+#include "matrix.hpp"
+
+#if MATRIX_DISPATCH
+#include <immintrin.h>
+#endif
+
+// Gather/scatter by lists of indices ("fancy indexing") and selection by
+// boolean masks. The names follow numpy: take, put, place.
+
+namespace indexing_impl {
+template <typename M>
+using Value = typename std::remove_const<typename M::value_type>::type;
+
+template <typename M>
+using Plain = typename std::remove_reference<M>::type;
+
+// d with dimension axis fixed at index i, kept as an extent of 1
+template <std::size_t N>
+MatrixSlice<N> fix(const MatrixSlice<N> &d, std::size_t axis, std::size_t i) {
+  MatrixSlice<N> s = d;
+  s.start += i * d.strides[axis];
+  s.extents[axis] = 1;
+  s.size = matrix_impl::compute_size(s.extents);
+  return s;
+}
+
+// Offset of the first element of every line along the last dimension
+template <std::size_t N>
+std::vector<std::size_t> line_starts(const MatrixSlice<N> &d) {
+  std::size_t lines = 1;
+  for (std::size_t i = 0; i + 1 < N; ++i)
+    lines *= d.extents[i];
+  std::vector<std::size_t> v(lines);
+  std::array<std::size_t, N> index{};
+  for (std::size_t l = 0; l != lines; ++l) {
+    std::size_t off = d.start;
+    for (std::size_t i = 0; i + 1 < N; ++i)
+      off += index[i] * d.strides[i];
+    v[l] = off;
+    for (std::size_t i = N - 1; i-- > 0;) {
+      if (++index[i] != d.extents[i])
+        break;
+      index[i] = 0;
+    }
+  }
+  return v;
+}
+
+template <std::size_t N> bool row_major_dense(const MatrixSlice<N> &d) {
+  std::array<std::size_t, N> strides;
+  matrix_impl::compute_strides(d.extents, strides);
+  return strides == d.strides;
+}
+
+// out[k] = src[idx[k]]
+template <typename U, typename T>
+void gather(const U *src, const std::size_t *idx, std::size_t n, T *out) {
+  for (std::size_t k = 0; k != n; ++k)
+    out[k] = src[idx[k]];
+}
+
+#if MATRIX_DISPATCH
+// The AVX2 gathers, taking 64-bit indices; they return how many elements
+// they fetched
+MATRIX_TARGET_AVX2 inline std::size_t
+gather_avx2(const double *src, const std::size_t *idx, std::size_t n,
+            double *out) {
+  std::size_t k = 0;
+  for (; k + 4 <= n; k += 4) {
+    const __m256i i = _mm256_loadu_si256((const __m256i *)(idx + k));
+    _mm256_storeu_pd(out + k, _mm256_i64gather_pd(src, i, 8));
+  }
+  return k;
+}
+
+MATRIX_TARGET_AVX2 inline std::size_t
+gather_avx2(const float *src, const std::size_t *idx, std::size_t n,
+            float *out) {
+  std::size_t k = 0;
+  for (; k + 4 <= n; k += 4) {
+    const __m256i i = _mm256_loadu_si256((const __m256i *)(idx + k));
+    _mm_storeu_ps(out + k, _mm256_i64gather_ps(src, i, 4));
+  }
+  return k;
+}
+#endif
+
+// gather with the AVX2 gather instructions when the active level has them
+template <typename T>
+void gather_fast(const T *src, const std::size_t *idx, std::size_t n,
+                 T *out) {
+  std::size_t k = 0;
+#if MATRIX_DISPATCH
+  if (sizeof(std::size_t) == 8 &&
+      matrix_impl::isa_level().load(std::memory_order_relaxed) >= isa::avx2)
+    k = gather_avx2(src, idx, n, out);
+#endif
+  for (; k != n; ++k)
+    out[k] = src[idx[k]];
+}
+
+inline void gather(const double *src, const std::size_t *idx, std::size_t n,
+                   double *out) {
+  gather_fast(src, idx, n, out);
+}
+
+inline void gather(const float *src, const std::size_t *idx, std::size_t n,
+                   float *out) {
+  gather_fast(src, idx, n, out);
+}
+
+template <typename I> std::vector<std::size_t> to_indices(const I &idx) {
+  static_assert(I::order() == 1, "index matrices must be 1-D");
+  std::vector<std::size_t> v;
+  v.reserve(idx.size());
+  MatrixRef<const typename I::value_type, 1> r(idx.descriptor(), idx.data());
+  for (const auto &i : r)
+    v.push_back(std::size_t(i));
+  return v;
+}
+
+// Call f(dst, src) for the hyperplane idx[k] along axis of (md, mp) and the
+// hyperplane k of (vd, vp), for every k
+template <std::size_t N, typename T, typename U, typename F>
+void scatter(const MatrixSlice<N> &md, T *mp, std::size_t axis,
+             const std::vector<std::size_t> &idx, const MatrixSlice<N> &vd,
+             const U *vp, F f) {
+  assert(axis < N && vd.extents[axis] == idx.size());
+  for (std::size_t i = 0; i != N; ++i)
+    assert((i == axis || vd.extents[i] == md.extents[i]) &&
+           "scatter: values do not match m off the axis");
+  if (axis + 1 == N) {
+    // element scatter along lines of both sides
+    const std::vector<std::size_t> ml = line_starts(md), vl = line_starts(vd);
+    const std::size_t ms = md.strides[N - 1], vs = vd.strides[N - 1];
+    for (std::size_t l = 0; l != ml.size(); ++l)
+      for (std::size_t k = 0; k != idx.size(); ++k) {
+        assert(idx[k] < md.extents[axis]);
+        f(mp[ml[l] + idx[k] * ms], vp[vl[l] + k * vs]);
+      }
+    return;
+  }
+  for (std::size_t k = 0; k != idx.size(); ++k) {
+    assert(idx[k] < md.extents[axis]);
+    MatrixRef<T, N> dst(fix(md, axis, idx[k]), mp);
+    MatrixRef<const U, N> src(fix(vd, axis, k), vp);
+    dst.apply(src, f);
+  }
+}
+} // namespace indexing_impl
+
+//! The hyperplanes idx[0], idx[1], ... of m along axis, as a compact Matrix
+//! (rows for axis 0 of a 2-D matrix, columns for axis 1). Dense rows are
+//! moved with memcpy; gathers along the last dimension use the AVX2 gather
+//! instructions when the CPU has them.
+template <typename M>
+Enable_if<Matrix_type<M>(), Matrix<indexing_impl::Value<M>, M::order()>>
+take(const M &m, std::size_t axis, const std::vector<std::size_t> &idx) {
+  using T = indexing_impl::Value<M>;
+  constexpr std::size_t N = M::order();
+  const MatrixSlice<N> &d = m.descriptor();
+  assert(axis < N);
+
+  std::array<std::size_t, N> exts = d.extents;
+  exts[axis] = idx.size();
+  Matrix<T, N> out(exts);
+  const MatrixSlice<N> &od = out.descriptor();
+
+  if (axis + 1 == N) {
+    const std::vector<std::size_t> ml = indexing_impl::line_starts(d);
+    const std::size_t n = idx.size(), s = d.strides[N - 1];
+    for (std::size_t k = 0; k != n; ++k)
+      assert(idx[k] < d.extents[axis]);
+    for (std::size_t l = 0; l != ml.size(); ++l) {
+      T *o = out.data() + l * n;
+      if (s == 1)
+        indexing_impl::gather(m.data() + ml[l], idx.data(), n, o);
+      else
+        for (std::size_t k = 0; k != n; ++k)
+          o[k] = m.data()[ml[l] + idx[k] * s];
+    }
+  } else if (axis == 0 && indexing_impl::row_major_dense(d) &&
+             std::is_trivially_copyable<T>::value) {
+    std::size_t len = 1; // elements per row, even with no rows
+    for (std::size_t i = 1; i != N; ++i)
+      len *= d.extents[i];
+    for (std::size_t k = 0; k != idx.size(); ++k) {
+      assert(idx[k] < d.extents[0]);
+      std::memcpy(out.data() + k * len, m.data() + d.start + idx[k] * len,
+                  len * sizeof(T));
+    }
+  } else {
+    for (std::size_t k = 0; k != idx.size(); ++k) {
+      assert(idx[k] < d.extents[axis]);
+      matrix_impl::blocked_copy(indexing_impl::fix(d, axis, idx[k]), m.data(),
+                                indexing_impl::fix(od, axis, k), out.data());
+    }
+  }
+  return out;
+}
+
+//! take with the indices given by a 1-D index matrix
+template <typename M, typename I>
+Enable_if<Matrix_type<M>() && Matrix_type<I>(),
+          Matrix<indexing_impl::Value<M>, M::order()>>
+take(const M &m, std::size_t axis, const I &idx) {
+  return take(m, axis, indexing_impl::to_indices(idx));
+}
+
+//! m's hyperplane idx[k] along axis = hyperplane k of values, for every k.
+//! With repeated indices the last write wins.
+template <typename M, typename V>
+Enable_if<Matrix_type<indexing_impl::Plain<M>>() && Matrix_type<V>(), void>
+put(M &&m, std::size_t axis, const std::vector<std::size_t> &idx,
+    const V &values) {
+  using T = typename indexing_impl::Plain<M>::value_type;
+  indexing_impl::scatter(m.descriptor(), m.data(), axis, idx,
+                         values.descriptor(), values.data(),
+                         [](T &x, const indexing_impl::Value<V> &v) { x = v; });
+}
+
+//! m's hyperplane idx[k] along axis += hyperplane k of values, for every k.
+//! Repeated indices accumulate.
+template <typename M, typename V>
+Enable_if<Matrix_type<indexing_impl::Plain<M>>() && Matrix_type<V>(), void>
+scatter_add(M &&m, std::size_t axis, const std::vector<std::size_t> &idx,
+            const V &values) {
+  using T = typename indexing_impl::Plain<M>::value_type;
+  indexing_impl::scatter(
+      m.descriptor(), m.data(), axis, idx, values.descriptor(), values.data(),
+      [](T &x, const indexing_impl::Value<V> &v) { x += v; });
+}
+
+//! put and scatter_add with the indices given by a 1-D index matrix
+///@{
+template <typename M, typename I, typename V>
+Enable_if<Matrix_type<indexing_impl::Plain<M>>() && Matrix_type<I>() &&
+              Matrix_type<V>(),
+          void>
+put(M &&m, std::size_t axis, const I &idx, const V &values) {
+  put(m, axis, indexing_impl::to_indices(idx), values);
+}
+
+template <typename M, typename I, typename V>
+Enable_if<Matrix_type<indexing_impl::Plain<M>>() && Matrix_type<I>() &&
+              Matrix_type<V>(),
+          void>
+scatter_add(M &&m, std::size_t axis, const I &idx, const V &values) {
+  scatter_add(m, axis, indexing_impl::to_indices(idx), values);
+}
+///@}
+
+//! The elements of m where mask is true, in logical (row-major) order
+template <typename M, typename K>
+Enable_if<Matrix_type<M>() && Matrix_type<K>(),
+          Matrix<indexing_impl::Value<M>, 1>>
+select(const M &m, const K &mask) {
+  constexpr std::size_t N = M::order();
+  assert(same_extents(m.descriptor(), mask.descriptor()));
+  MatrixRef<const typename M::value_type, N> mr(m.descriptor(), m.data());
+  MatrixRef<const typename K::value_type, N> kr(mask.descriptor(),
+                                                mask.data());
+
+  std::size_t n = 0;
+  for (const auto &k : kr)
+    n += bool(k);
+  Matrix<indexing_impl::Value<M>, 1> out(n);
+  auto o = out.begin();
+  auto k = kr.begin();
+  for (auto i = mr.begin(); i != mr.end(); ++i, ++k)
+    if (*k)
+      *o++ = *i;
+  return out;
+}
+
+//! Write values[0], values[1], ... to the elements of m where mask is true,
+//! in logical order; the inverse of select
+template <typename M, typename K, typename V>
+Enable_if<Matrix_type<indexing_impl::Plain<M>>() && Matrix_type<K>() &&
+              Matrix_type<V>(),
+          void>
+place(M &&m, const K &mask, const V &values) {
+  using P = indexing_impl::Plain<M>;
+  constexpr std::size_t N = P::order();
+  assert(same_extents(m.descriptor(), mask.descriptor()));
+  MatrixRef<typename P::value_type, N> mr(m.descriptor(), m.data());
+  MatrixRef<const typename K::value_type, N> kr(mask.descriptor(),
+                                                mask.data());
+  MatrixRef<const typename V::value_type, 1> vr(values.descriptor(),
+                                                values.data());
+
+  auto v = vr.begin();
+  auto k = kr.begin();
+  for (auto i = mr.begin(); i != mr.end(); ++i, ++k)
+    if (*k) {
+      assert(v != vr.end());
+      *i = *v++;
+    }
+}
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Opt-in accounting of where memory traffic comes from and of how long the
+// operations take. Build with MATRIX_INSTRUMENT=1 to enable it. Otherwise the
+// hooks are empty inline functions, the macros expand to nothing, and the
+// queries below report zeros.
+//
+// The setting must be the same for every translation unit of a program: it
+// changes the bodies of inline functions and templates such as the Matrix
+// copy constructor, and the linker keeps one definition of each. Set it on
+// the command line of the whole build (the MATRIX_INSTRUMENT CMake option
+// does), not in a source file. The hooks of the two builds live in inline
+// namespaces of different names, so one build's hooks never stand in for the
+// other's.
+//
+// Allocations and deep copies of Matrix storage are charged to the innermost
+// MATRIX_TAG scope of the thread making them ("untagged" outside any). The
+// parallel kernels pass the tag on to their worker threads. Operations
+// marked MATRIX_TIMED add their duration to a histogram with power-of-two
+// buckets. Each thread records into its own tables. A query merges the
+// tables of all threads, so call it while nothing instrumented is running.
+//
+// Tags and operation names are keyed by address: pass string literals.
+
+#ifndef MATRIX_INSTRUMENT
+#define MATRIX_INSTRUMENT 0
+#endif
+
+//! memory traffic charged to a tag
+struct traffic_stats {
+  std::size_t allocations = 0;     //!< storage allocations
+  std::size_t bytes_allocated = 0; //!< bytes they reserved
+  std::size_t copies = 0;          //!< deep copies of elements
+  std::size_t bytes_copied = 0;    //!< bytes they wrote
+};
+
+//! durations of a timed operation
+struct op_timing {
+  static constexpr std::size_t buckets = 40;
+
+  std::size_t count = 0;      //!< calls
+  std::uint64_t total_ns = 0; //!< their total duration
+  //! histogram[b] counts the calls that took [2^b, 2^(b+1)) ns; bucket 0
+  //! also takes 0 ns and the last one everything longer
+  std::array<std::size_t, buckets> histogram{};
+};
+
+namespace instrument_impl {
+inline void add(traffic_stats &x, const traffic_stats &y) {
+  x.allocations += y.allocations;
+  x.bytes_allocated += y.bytes_allocated;
+  x.copies += y.copies;
+  x.bytes_copied += y.bytes_copied;
+}
+
+inline void add(op_timing &x, const op_timing &y) {
+  x.count += y.count;
+  x.total_ns += y.total_ns;
+  for (std::size_t b = 0; b != op_timing::buckets; ++b)
+    x.histogram[b] += y.histogram[b];
+}
+
+// Merged records, by name
+struct report {
+  std::map<std::string, traffic_stats> traffic;
+  std::map<std::string, op_timing> timing;
+};
+
+#if MATRIX_INSTRUMENT
+inline namespace instrumented {
+struct thread_log;
+
+// The logs of the live threads, and the merged records of those that exited
+struct registry {
+  std::mutex m;
+  std::vector<thread_log *> live;
+  report retired;
+};
+
+inline registry &global() {
+  static registry r;
+  return r;
+}
+
+// One thread's records. Its mutex is only contended while a query runs.
+struct thread_log {
+  std::mutex m;
+  std::unordered_map<const char *, traffic_stats> traffic;
+  std::unordered_map<const char *, op_timing> timing;
+  const char *tag = "untagged";
+
+  thread_log() {
+    registry &r = global();
+    std::lock_guard<std::mutex> lock(r.m);
+    r.live.push_back(this);
+  }
+
+  ~thread_log() {
+    registry &r = global();
+    std::lock_guard<std::mutex> lock(r.m);
+    merge_into(r.retired);
+    for (std::size_t i = 0; i != r.live.size(); ++i)
+      if (r.live[i] == this) {
+        r.live[i] = r.live.back();
+        r.live.pop_back();
+        break;
+      }
+  }
+
+  void merge_into(report &out) {
+    std::lock_guard<std::mutex> lock(m);
+    for (const auto &t : traffic)
+      add(out.traffic[t.first], t.second);
+    for (const auto &t : timing)
+      add(out.timing[t.first], t.second);
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(m);
+    traffic.clear();
+    timing.clear();
+  }
+};
+
+inline thread_log &local() {
+  static thread_local thread_log log;
+  return log;
+}
+
+inline void note_alloc(std::size_t bytes) {
+  if (bytes == 0)
+    return;
+  thread_log &l = local();
+  std::lock_guard<std::mutex> lock(l.m);
+  traffic_stats &s = l.traffic[l.tag];
+  ++s.allocations;
+  s.bytes_allocated += bytes;
+}
+
+inline void note_copy(std::size_t bytes) {
+  thread_log &l = local();
+  std::lock_guard<std::mutex> lock(l.m);
+  traffic_stats &s = l.traffic[l.tag];
+  ++s.copies;
+  s.bytes_copied += bytes;
+}
+
+inline const char *current_tag() { return local().tag; }
+
+// Charges the allocations and copies of its lifetime to name
+class tag_scope {
+public:
+  explicit tag_scope(const char *name) : prev_(local().tag) {
+    local().tag = name;
+  }
+  ~tag_scope() { local().tag = prev_; }
+  tag_scope(const tag_scope &) = delete;
+  tag_scope &operator=(const tag_scope &) = delete;
+
+private:
+  const char *prev_;
+};
+
+// Records its lifetime as one call of name
+class timer {
+public:
+  explicit timer(const char *name)
+      : name_(name), t0_(std::chrono::steady_clock::now()) {}
+  ~timer() {
+    const std::uint64_t ns = std::uint64_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - t0_)
+            .count());
+    std::size_t b = 0;
+    for (std::uint64_t x = ns; x > 1 && b + 1 != op_timing::buckets; x >>= 1)
+      ++b;
+    thread_log &l = local();
+    std::lock_guard<std::mutex> lock(l.m);
+    op_timing &t = l.timing[name_];
+    ++t.count;
+    t.total_ns += ns;
+    ++t.histogram[b];
+  }
+  timer(const timer &) = delete;
+  timer &operator=(const timer &) = delete;
+
+private:
+  const char *name_;
+  std::chrono::steady_clock::time_point t0_;
+};
+
+inline report collect() {
+  registry &r = global();
+  std::lock_guard<std::mutex> lock(r.m);
+  report out = r.retired;
+  for (thread_log *l : r.live)
+    l->merge_into(out);
+  return out;
+}
+
+inline void reset() {
+  registry &r = global();
+  std::lock_guard<std::mutex> lock(r.m);
+  r.retired = report{};
+  for (thread_log *l : r.live)
+    l->clear();
+}
+
+// Note an allocation if v outgrew the capacity it had before
+template <typename V> void note_growth(const V &v, std::size_t old_capacity) {
+  if (v.capacity() > old_capacity)
+    note_alloc(v.capacity() * sizeof(typename V::value_type));
+}
+} // namespace instrumented
+
+#define MATRIX_INSTRUMENT_CAT2(a, b) a##b
+#define MATRIX_INSTRUMENT_CAT(a, b) MATRIX_INSTRUMENT_CAT2(a, b)
+
+//! charge the allocations and copies of the enclosing scope to name
+#define MATRIX_TAG(name)                                                       \
+  instrument_impl::tag_scope MATRIX_INSTRUMENT_CAT(matrix_tag_,               \
+                                                   __LINE__)(name)
+//! time the enclosing scope as one call of the operation name
+#define MATRIX_TIMED(name)                                                     \
+  instrument_impl::timer MATRIX_INSTRUMENT_CAT(matrix_timer_, __LINE__)(name)
+#else
+inline namespace plain {
+inline void note_alloc(std::size_t) {}
+inline void note_copy(std::size_t) {}
+inline const char *current_tag() { return nullptr; }
+
+class tag_scope {
+public:
+  explicit tag_scope(const char *) {}
+};
+
+inline report collect() { return {}; }
+inline void reset() {}
+template <typename V> void note_growth(const V &, std::size_t) {}
+} // namespace plain
+
+#define MATRIX_TAG(name)
+#define MATRIX_TIMED(name)
+#endif
+
+inline void write_string(std::ostream &os, const std::string &s) {
+  os << '"';
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      os << '\\' << c;
+    else if (static_cast<unsigned char>(c) < 0x20)
+      os << ' ';
+    else
+      os << c;
+  }
+  os << '"';
+}
+} // namespace instrument_impl
+
+// The queries call the hooks of their build, so they are kept apart too
+#if MATRIX_INSTRUMENT
+inline namespace matrix_instrumented {
+#else
+inline namespace matrix_plain {
+#endif
+//! whether the library was built with MATRIX_INSTRUMENT
+constexpr bool instrumented() { return MATRIX_INSTRUMENT != 0; }
+
+//! memory traffic charged to tag, over all threads
+inline traffic_stats instrument_traffic(const std::string &tag) {
+  const instrument_impl::report r = instrument_impl::collect();
+  const auto i = r.traffic.find(tag);
+  return i == r.traffic.end() ? traffic_stats{} : i->second;
+}
+
+//! timings of the operation op, over all threads
+inline op_timing instrument_timing(const std::string &op) {
+  const instrument_impl::report r = instrument_impl::collect();
+  const auto i = r.timing.find(op);
+  return i == r.timing.end() ? op_timing{} : i->second;
+}
+
+//! forget everything recorded so far
+inline void instrument_reset() { instrument_impl::reset(); }
+
+//! Write every record as JSON: {"traffic": {tag: {...}}, "timing": {op:
+//! {"count", "total_ns", "histogram_ns": {lower bound in ns: calls}}}}
+inline void instrument_json(std::ostream &os) {
+  const instrument_impl::report r = instrument_impl::collect();
+  os << "{\"traffic\": {";
+  const char *sep = "";
+  for (const auto &t : r.traffic) {
+    os << sep;
+    instrument_impl::write_string(os, t.first);
+    os << ": {\"allocations\": " << t.second.allocations
+       << ", \"bytes_allocated\": " << t.second.bytes_allocated
+       << ", \"copies\": " << t.second.copies
+       << ", \"bytes_copied\": " << t.second.bytes_copied << '}';
+    sep = ", ";
+  }
+  os << "}, \"timing\": {";
+  sep = "";
+  for (const auto &t : r.timing) {
+    os << sep;
+    instrument_impl::write_string(os, t.first);
+    os << ": {\"count\": " << t.second.count
+       << ", \"total_ns\": " << t.second.total_ns << ", \"histogram_ns\": {";
+    const char *bsep = "";
+    for (std::size_t b = 0; b != op_timing::buckets; ++b)
+      if (t.second.histogram[b] != 0) {
+        os << bsep << "\"" << (b == 0 ? 0 : std::uint64_t(1) << b)
+           << "\": " << t.second.histogram[b];
+        bsep = ", ";
+      }
+    os << "}}";
+    sep = ", ";
+  }
+  os << "}}";
+}
+} // inline namespace matrix_instrumented / matrix_plain
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "matrix_impl.hpp"
+
+// Memory layout policies for Matrix. A strided layout maps an index to
+// start + sum(i_k * stride_k), so every view into it is a plain MatrixRef;
+// unit_stride says the last dimension is dense, so that rows and row blocks
+// can be ContiguousRefs (see contiguous_ref.hpp).
+
+//! C order: the last index varies fastest (the default)
+struct row_major {
+  static constexpr bool strided = true;
+  static constexpr bool unit_stride = true;
+
+  template <std::size_t N>
+  static std::size_t compute_strides(const std::array<std::size_t, N> &extents,
+                                     std::array<std::size_t, N> &strides) {
+    return matrix_impl::compute_strides(extents, strides);
+  }
+};
+
+//! Fortran order: the first index varies fastest
+struct column_major {
+  static constexpr bool strided = true;
+  static constexpr bool unit_stride = false;
+
+  template <std::size_t N>
+  static std::size_t compute_strides(const std::array<std::size_t, N> &extents,
+                                     std::array<std::size_t, N> &strides) {
+    std::size_t size = 1;
+    for (std::size_t i = 0; i != N; ++i) {
+      strides[i] = size;
+      size *= extents[i];
+    }
+    return size;
+  }
+};
+
+//! B x B tiles, each stored contiguously in row-major order, with the tiles
+//! themselves laid out along a Z-order (Morton) curve. Only for 2-D matrices.
+//! The default tile of 32 x 32 doubles (8 KiB) fits comfortably in L1.
+template <std::size_t B = 32> struct tiled {
+  static_assert(B > 0 && (B & (B - 1)) == 0,
+                "tiled: the tile size must be a power of two");
+
+  static constexpr bool strided = false;
+  static constexpr bool unit_stride = false;
+  static constexpr std::size_t tile = B;
+};
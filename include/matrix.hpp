@@ -1,63 +1,104 @@
 #pragma once
 
+#include "bool_vector.hpp"
+#include "contiguous_ref.hpp"
+#include "instrument.hpp"
+#include "layout.hpp"
 #include "matrix_base.hpp"
 #include "matrix_fwd.hpp"
 #include "matrix_impl.hpp"
 #include "matrix_ref.hpp"
 #include "matrix_slice.hpp"
 
-template <typename T, std::size_t N> class Matrix : public MatrixBase<T, N> {
+// L is the memory layout policy (see layout.hpp). Strided layouts only change
+// the strides of the descriptor, so subscripting, slicing and views work the
+// same for all of them; the tiled layout is specialized in matrix_tiled.hpp.
+template <typename T, std::size_t N, typename L>
+class Matrix : public MatrixBase<T, N> {
+  static_assert(L::strided, "Matrix: this layout is not available for order N");
+
+  // Rows, row blocks and column blocks keep a dense last dimension when L
+  // does, and are then ContiguousRefs
+  template <typename U, std::size_t M>
+  using row_view = typename std::conditional<L::unit_stride, Unit_view<U, M>,
+                                             MatrixRef<U, M>>::type;
+
 public:
   //! @cond Doxygen_Suppress
-  using iterator = typename std::vector<T>::iterator;
-  using const_iterator = typename std::vector<T>::const_iterator;
+  using storage_type = typename matrix_impl::Storage<T>::type;
+  using iterator = typename storage_type::iterator;
+  using const_iterator = typename storage_type::const_iterator;
 
   Matrix() = default;
   Matrix(Matrix &&) = default; // move
   Matrix &operator=(Matrix &&) = default;
-  Matrix(const Matrix &) = default; // copy
-  Matrix &operator=(const Matrix &) = default;
+  Matrix(const Matrix &x) // copy
+      : MatrixBase<T, N>(x.descriptor()), elems_(x.elems_) {
+    instrument_impl::note_growth(elems_, 0);
+    instrument_impl::note_copy(elems_.size() * sizeof(T));
+  }
+  Matrix &operator=(const Matrix &x) {
+    const std::size_t cap = elems_.capacity();
+    MatrixBase<T, N>::operator=(x);
+    elems_ = x.elems_;
+    instrument_impl::note_growth(elems_, cap);
+    instrument_impl::note_copy(elems_.size() * sizeof(T));
+    return *this;
+  }
   ~Matrix() = default;
 
-  //! construct from Matrix
+  //! construct from Matrix (of any strided layout)
   template <typename M, typename = Enable_if<Matrix_type<M>()>>
-  Matrix(const M &x)
-      : MatrixBase<T, N>(x.descriptor()), elems_(x.begin(), x.end()) {
+  Matrix(const M &x) {
     static_assert(Convertible<typename M::value_type, T>(), "");
+    copy_from(x.descriptor(), x.data());
   }
   //! assign from Matrix
   template <typename M, typename = Enable_if<Matrix_type<M>()>>
   Matrix &operator=(const M &x) {
     static_assert(Convertible<typename M::value_type, T>(), "");
-
-    this->desc_ = x.descriptor();
-    elems_.assign(x.begin(), x.end());
+    copy_from(x.descriptor(), x.data());
     return *this;
   }
 
   //! construct from MatrixRef
-  template <typename U>
-  Matrix(const MatrixRef<U, N> &x)
-      : MatrixBase<T, N>{x.descriptor().extents}, elems_{x.begin(), x.end()} {
+  template <typename U> Matrix(const MatrixRef<U, N> &x) {
     static_assert(Convertible<U, T>(),
                   "Matrix constructor: incompatible element types");
+    copy_from(x.descriptor(), x.data());
   }
   //! assign from MatrixRef
   template <typename U> Matrix &operator=(const MatrixRef<U, N> &x) {
     static_assert(Convertible<U, T>(), "Matrix =: incompatible element types");
-
-    this->desc_ = x.descriptor();
-    this->desc_.start = 0;
-    elems_.assign(x.begin(), x.end());
+    copy_from(x.descriptor(), x.data());
     return *this;
   }
 
+  //! construct from a tiled Matrix
+  template <typename U, std::size_t B>
+  Matrix(const Matrix<U, N, tiled<B>> &x) {
+    set_extents({{x.n_rows(), x.n_cols()}});
+    resize_elems(this->desc_.size);
+    x.copy_to(this->desc_, data());
+    instrument_impl::note_copy(elems_.size() * sizeof(T));
+  }
+
   //! specify the extents
-  template <typename... Exts>
+  template <typename... Exts,
+            typename = Enable_if<All(Convertible<Exts, std::size_t>()...)>>
   explicit Matrix(Exts... exts)
       : MatrixBase<T, N>{exts...}, // copy extents
         elems_(this->desc_.size) // allocate desc_.size elements and initialize
-  {}
+  {
+    L::compute_strides(this->desc_.extents, this->desc_.strides);
+    instrument_impl::note_growth(elems_, 0);
+  }
+
+  //! specify the extents as an array
+  explicit Matrix(const std::array<std::size_t, N> &exts) {
+    set_extents(exts);
+    resize_elems(this->desc_.size);
+  }
 
   //! initialize from list
   Matrix(MatrixInitializer<T, N> init) {
@@ -67,11 +108,9 @@ public:
     this->desc_.extents = matrix_impl::derive_extents<N>(init);
     // compute strides and size
     this->desc_.size =
-        matrix_impl::compute_strides(this->desc_.extents, this->desc_.strides);
+        L::compute_strides(this->desc_.extents, this->desc_.strides);
 
-    elems_.reserve(this->desc_.size);       // make room for slices
-    matrix_impl::insert_flat(init, elems_); // initialize from initializer list
-    assert(elems_.size() == this->desc_.size);
+    fill_from_list(init);
   };
 
   //! assign from list
@@ -84,11 +123,9 @@ public:
     this->desc_.extents = matrix_impl::derive_extents<N>(init);
     // compute strides and size
     this->desc_.size =
-        matrix_impl::compute_strides(this->desc_.extents, this->desc_.strides);
+        L::compute_strides(this->desc_.extents, this->desc_.strides);
 
-    elems_.reserve(this->desc_.size);       // make room for slices
-    matrix_impl::insert_flat(init, elems_); // initialize from initializer list
-    assert(elems_.size() == this->desc_.size);
+    fill_from_list(init);
 
     return *this;
   }
@@ -114,8 +151,173 @@ public:
   const T *data() const { return elems_.data(); }
   ///@}
 
+  //! Growth along the first dimension, for row-major matrices. As with
+  //! std::vector, an append keeps the rows written so far in place and
+  //! reallocates only when the capacity runs out, then doubling it. Views,
+  //! iterators and pointers into the matrix stay valid across appends that
+  //! do not reallocate (while n_rows() < row_capacity(), which reserve_rows
+  //! can ensure up front), and keep seeing the rows they were made with. A
+  //! reallocating append, shrink_to_fit() and every assignment invalidate
+  //! them. The first row appended to a matrix without rows sets the extents
+  //! of the rows, as reserve_rows(n, row extents) does.
+  ///@{
+
+  //! rows the storage holds without reallocating
+  std::size_t row_capacity() const {
+    const std::size_t n = row_size();
+    return n == 0 ? this->n_rows() : elems_.capacity() / n;
+  }
+
+  //! make room for n rows in all; the matrix must know the extents of its
+  //! rows, which a default-constructed one does not: give them with the
+  //! overload below
+  void reserve_rows(std::size_t n) {
+    static_assert(Same<L, row_major>(), "Matrix: rows append to row_major");
+    assert((row_size() != 0 || this->n_rows() != 0) &&
+           "Matrix::reserve_rows: row extents unknown");
+    const std::size_t cap = elems_.capacity();
+    elems_.reserve(n * row_size());
+    instrument_impl::note_growth(elems_, cap);
+  }
+
+  //! make room for n rows with the given extents, e.g.
+  //! m.reserve_rows(1000, 3) for 1000 rows of 3; sets them on a matrix
+  //! without rows, and must match them otherwise
+  template <typename... Exts> void reserve_rows(std::size_t n, Exts... exts) {
+    static_assert(sizeof...(Exts) == N - 1,
+                  "Matrix::reserve_rows: wrong number of row extents");
+    const std::array<std::size_t, N> e = {{0, std::size_t(exts)...}};
+    if (this->n_rows() == 0) {
+      set_extents(e);
+      elems_.clear();
+    }
+    assert(std::equal(e.begin() + 1, e.end(),
+                      this->desc_.extents.begin() + 1) &&
+           "Matrix::reserve_rows: row extents mismatch");
+    reserve_rows(n);
+  }
+
+  //! append a copy of row, a Matrix or MatrixRef of order N - 1
+  template <typename M, std::size_t NN = N>
+  Enable_if<Matrix_type<M>() && (NN > 1), row_view<T, N - 1>>
+  append_row(const M &row) {
+    static_assert(M::order() == N - 1, "Matrix::append_row: wrong order");
+    static_assert(Convertible<typename M::value_type, T>(),
+                  "Matrix::append_row: incompatible element types");
+    const MatrixSlice<N - 1> &rd = row.descriptor();
+    if (this->n_rows() == 0) {
+      std::array<std::size_t, N> exts;
+      exts[0] = 0;
+      std::copy(rd.extents.begin(), rd.extents.end(), exts.begin() + 1);
+      set_extents(exts);
+      elems_.clear();
+    }
+    MatrixSlice<N - 1> d;
+    matrix_impl::slice_dim<0>(this->n_rows(), this->desc_, d);
+    assert(same_extents(rd, d));
+    if (elems_.size() + d.size > elems_.capacity()) {
+      // row may view this matrix, whose storage growing frees: copy it first
+      MatrixSlice<N - 1> dense = d;
+      dense.start = 0;
+      storage_type copy(d.size);
+      matrix_impl::blocked_copy(rd, row.data(), dense, copy.data());
+      grow_rows(1);
+      std::copy(copy.begin(), copy.end(), data() + d.start);
+    } else {
+      grow_rows(1);
+      matrix_impl::blocked_copy(rd, row.data(), d, data());
+    }
+    return {d, data()};
+  }
+
+  //! append a row of value-initialized elements and return it, to fill in
+  //! place; the matrix must know the extents of its rows
+  template <std::size_t NN = N>
+  Enable_if<(NN > 1), row_view<T, N - 1>> append_row() {
+    MatrixSlice<N - 1> d;
+    matrix_impl::slice_dim<0>(this->n_rows(), this->desc_, d);
+    grow_rows(1);
+    return {d, data()};
+  }
+
+  //! append an element to a 1-D matrix
+  template <std::size_t NN = N>
+  Enable_if<(NN == 1), T &> append_row(const T &x) {
+    const T v = x; // x may be an element of this matrix
+    grow_rows(1);
+    return elems_[elems_.size() - 1] = v;
+  }
+
+  //! release the capacity beyond the rows there are
+  void shrink_to_fit() { elems_.shrink_to_fit(); }
+  ///@}
+
 private:
-  std::vector<T> elems_; // the elements
+  storage_type elems_; // the elements
+
+  // Elements per row, i.e. per index of the first dimension
+  std::size_t row_size() const {
+    std::size_t n = 1;
+    for (std::size_t i = 1; i != N; ++i)
+      n *= this->desc_.extents[i];
+    return n;
+  }
+
+  // Add n value-initialized rows at the end, at least doubling the
+  // capacity when it has to grow so that appending is amortized O(1)
+  void grow_rows(std::size_t n) {
+    static_assert(Same<L, row_major>(), "Matrix: rows append to row_major");
+    const std::size_t size = elems_.size() + n * row_size();
+    const std::size_t cap = elems_.capacity();
+    if (size > cap) {
+      elems_.reserve(std::max(size, 2 * cap));
+      instrument_impl::note_growth(elems_, cap);
+    }
+    elems_.resize(size);
+    this->desc_.extents[0] += n;
+    this->desc_.size = size;
+  }
+
+  // Reset the descriptor to the given extents with the strides of layout L
+  void set_extents(const std::array<std::size_t, N> &exts) {
+    this->desc_.start = 0;
+    this->desc_.extents = exts;
+    this->desc_.size =
+        L::compute_strides(this->desc_.extents, this->desc_.strides);
+  }
+
+  // Resize the storage, noting any allocation for instrumentation
+  void resize_elems(std::size_t n) {
+    const std::size_t cap = elems_.capacity();
+    elems_.resize(n);
+    instrument_impl::note_growth(elems_, cap);
+  }
+
+  // Take the extents of s and copy its elements, whatever its strides
+  template <typename U> void copy_from(const MatrixSlice<N> &s, const U *p) {
+    set_extents(s.extents);
+    resize_elems(this->desc_.size);
+    matrix_impl::blocked_copy(s, p, this->desc_, data());
+    instrument_impl::note_copy(elems_.size() * sizeof(T));
+  }
+
+  // The initializer list is in row-major order: append it directly when that
+  // is also the storage order, otherwise scatter it through a strided view
+  void fill_from_list(MatrixInitializer<T, N> init) {
+    const std::size_t cap = elems_.capacity();
+    if (Same<L, row_major>()) {
+      elems_.reserve(this->desc_.size);       // make room for slices
+      matrix_impl::insert_flat(init, elems_); // initialize from list
+    } else {
+      elems_.resize(this->desc_.size);
+      MatrixRef<T, N> ref(this->desc_, data());
+      auto iter = ref.begin();
+      matrix_impl::copy_flat(init, iter);
+    }
+    assert(elems_.size() == this->desc_.size);
+    instrument_impl::note_growth(elems_, cap);
+    instrument_impl::note_copy(elems_.size() * sizeof(T));
+  }
 
 public:
   //! m(i,j,k) subscripting with integers
@@ -142,19 +344,19 @@ public:
 
   //! m[i] row access
   ///@{
-  MatrixRef<T, N - 1> operator[](std::size_t i) { return row(i); }
-  MatrixRef<const T, N - 1> operator[](std::size_t i) const { return row(i); }
+  row_view<T, N - 1> operator[](std::size_t i) { return row(i); }
+  row_view<const T, N - 1> operator[](std::size_t i) const { return row(i); }
   ///@}
 
   //! row access
-  MatrixRef<T, N - 1> row(std::size_t n) {
+  row_view<T, N - 1> row(std::size_t n) {
     assert(n < this->n_rows());
     MatrixSlice<N - 1> row;
     matrix_impl::slice_dim<0>(n, this->desc_, row);
     return {row, data()};
   };
 
-  MatrixRef<const T, N - 1> row(std::size_t n) const {
+  row_view<const T, N - 1> row(std::size_t n) const {
     assert(n < this->n_rows());
     MatrixSlice<N - 1> row;
     matrix_impl::slice_dim<0>(n, this->desc_, row);
@@ -177,7 +379,7 @@ public:
   };
 
   //! multiple rows access
-  MatrixRef<T, N> rows(std::size_t i, std::size_t j) {
+  row_view<T, N> rows(std::size_t i, std::size_t j) {
     assert(i <= j);
     assert(j < this->n_rows());
 
@@ -190,10 +392,11 @@ public:
       d.start += matrix_impl::do_slice_dim2(this->desc_, d, slice{0}, NRest);
       --NRest;
     }
+    d.size = matrix_impl::compute_size(d.extents);
     return {d, data()};
   };
 
-  MatrixRef<const T, N> rows(std::size_t i, std::size_t j) const {
+  row_view<const T, N> rows(std::size_t i, std::size_t j) const {
     assert(i <= j);
     assert(j < this->n_rows());
 
@@ -206,11 +409,12 @@ public:
       d.start += matrix_impl::do_slice_dim2(this->desc_, d, slice{0}, NRest);
       --NRest;
     }
+    d.size = matrix_impl::compute_size(d.extents);
     return {d, data()};
   };
 
   //! multiple columns access
-  MatrixRef<T, N> cols(std::size_t i, std::size_t j) {
+  row_view<T, N> cols(std::size_t i, std::size_t j) {
     assert(N >= 2);
     assert(i <= j);
     assert(j < this->n_cols());
@@ -226,10 +430,11 @@ public:
       d.start += matrix_impl::do_slice_dim2(this->desc_, d, slice{0}, NRest);
       --NRest;
     }
+    d.size = matrix_impl::compute_size(d.extents);
     return {d, data()};
   };
 
-  MatrixRef<const T, N> cols(std::size_t i, std::size_t j) const {
+  row_view<const T, N> cols(std::size_t i, std::size_t j) const {
     assert(N >= 2);
     assert(i <= j);
     assert(j < this->n_cols());
@@ -245,10 +450,11 @@ public:
       d.start += matrix_impl::do_slice_dim2(this->desc_, d, slice{0}, NRest);
       --NRest;
     }
+    d.size = matrix_impl::compute_size(d.extents);
     return {d, data()};
   };
 
-  //! element iterators
+  //! element iterators, in storage order (so layout dependent)
   iterator begin() { return elems_.begin(); }
   const_iterator begin() const { return elems_.cbegin(); }
   iterator end() { return elems_.end(); }
@@ -267,10 +473,30 @@ public:
   template <typename M, typename F>
   Enable_if<Matrix_type<M>(), Matrix &> apply(const M &m, F f) {
     assert(same_extents(this->desc_, m.descriptor()));
-    auto j = m.begin();
-    for (auto i = begin(); i != end(); ++i) {
-      f(*i, *j);
-      ++j;
+    const MatrixSlice<N> &md = m.descriptor();
+    if (md.strides == this->desc_.strides && matrix_impl::is_contiguous(md)) {
+      // same storage order: walk both flat
+      auto j = m.data() + md.start;
+      for (auto i = begin(); i != end(); ++i) {
+        f(*i, *j);
+        ++j;
+      }
+    } else if (L::unit_stride && md.strides[N - 1] == 1) {
+      // both dense along the last dimension: walk line by line
+      using U = const typename M::value_type;
+      matrix_impl::for_each_line(this->desc_, data(), md, m.data(),
+                                 [&](T *p, U *q, std::size_t n) {
+                                   for (std::size_t k = 0; k != n; ++k)
+                                     f(p[k], q[k]);
+                                 });
+    } else {
+      MatrixRef<T, N> self(this->desc_, data());
+      MatrixRef<const typename M::value_type, N> other(md, m.data());
+      auto j = other.begin();
+      for (auto i = self.begin(); i != self.end(); ++i) {
+        f(*i, *j);
+        ++j;
+      }
     }
 
     return *this;
@@ -278,7 +504,8 @@ public:
 };
 
 // Specialization for 0-dimensional matrix
-template <typename T> class Matrix<T, 0> : public MatrixBase<T, 0> {
+template <typename T, typename L>
+class Matrix<T, 0, L> : public MatrixBase<T, 0> {
 public:
   //! @cond Doxygen_Suppress
   using iterator = typename std::array<T, 1>::iterator;
@@ -325,3 +552,5 @@ public:
 private:
   std::array<T, 1> elem_;
 };
+
+#include "matrix_tiled.hpp"
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "matrix_slice.hpp"
+#include <cassert>
 #include <cstddef>
 #include <iostream>
 #include <vector>
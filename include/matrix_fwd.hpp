@@ -4,7 +4,10 @@
 
 template <size_t N> struct MatrixSlice;
 
-template <typename T, size_t N> class Matrix;
+struct row_major;
+
+template <typename T, size_t N, typename L = row_major> class Matrix;
 template <typename T, size_t N> class MatrixRef;
+template <typename T, size_t N> class ContiguousRef;
 
 struct slice;
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
 #include <cstddef>
 #include <functional>
 #include <numeric>
 
+#include "dispatch.hpp"
 #include "matrix_fwd.hpp"
 #include "matrix_slice.hpp"
 #include "slice.hpp"
@@ -76,15 +79,15 @@ bool check_non_jagged(const List &list) {
 }
 
 template <typename T, typename Vec>
-void add_list(std::initializer_list<T> *first, std::initializer_list<T> *last,
-              Vec &vec) {
-  for (; first != last; ++first)
-    add_list(first->begin(), first->end(), vec);
+void add_list(const T *first, const T *last, Vec &vec) {
+  vec.insert(vec.end(), first, last);
 }
 
 template <typename T, typename Vec>
-void add_list(const T *first, const T *last, Vec &vec) {
-  vec.insert(vec.end(), first, last);
+void add_list(const std::initializer_list<T> *first,
+              const std::initializer_list<T> *last, Vec &vec) {
+  for (; first != last; ++first)
+    add_list(first->begin(), first->end(), vec);
 }
 
 // Put the elements of the initializer_list into the vector
@@ -194,6 +197,145 @@ void copy_flat(std::initializer_list<T> list, Iter &iter) {
   copy_list(list.begin(), list.end(), iter);
 }
 
+// Offset of the first element of line l, lines being the runs along the last
+// dimension in logical order
+template <std::size_t N>
+std::size_t line_offset(const MatrixSlice<N> &d, std::size_t l) {
+  std::size_t off = d.start;
+  for (std::size_t i = N - 1; i-- > 0;) {
+    off += l % d.extents[i] * d.strides[i];
+    l /= d.extents[i];
+  }
+  return off;
+}
+
+template <std::size_t N> std::size_t line_count(const MatrixSlice<N> &d) {
+  return d.extents[N - 1] == 0 ? 0 : d.size / d.extents[N - 1];
+}
+
+// d with dimension axis moved last, so that its lines are the lines of d
+// along axis
+template <std::size_t N>
+MatrixSlice<N> axis_last(const MatrixSlice<N> &d, std::size_t axis) {
+  assert(axis < N);
+  MatrixSlice<N> r = d;
+  std::rotate(r.extents.begin() + axis, r.extents.begin() + axis + 1,
+              r.extents.end());
+  std::rotate(r.strides.begin() + axis, r.strides.begin() + axis + 1,
+              r.strides.end());
+  return r;
+}
+
+// True when the slice covers a dense block of memory in row-major or
+// column-major order
+template <std::size_t N> bool is_contiguous(const MatrixSlice<N> &d) {
+  std::size_t rm = 1, cm = 1;
+  bool row = true, col = true;
+  for (std::size_t i = 0; i != N; ++i) {
+    col = col && (d.extents[i] == 1 || d.strides[i] == cm);
+    cm *= d.extents[i];
+    row = row && (d.extents[N - 1 - i] == 1 || d.strides[N - 1 - i] == rm);
+    rm *= d.extents[N - 1 - i];
+  }
+  return row || col;
+}
+
+// Copy n dense elements, converting them from U to T. Specialized for the
+// element types that have a vectorized conversion (see half.hpp).
+template <typename U, typename T> struct convert_n {
+  static void run(const U *s, T *d, std::size_t n) { std::copy(s, s + n, d); }
+};
+
+// Side of the square blocks walked by blocked_copy. 32 x 32 doubles on each
+// side of the copy stay well inside L1.
+constexpr std::size_t copy_block = 32;
+
+// One ni x nj block of a strided copy, such as a transpose
+struct copy_block_kernel {
+  template <typename U, typename T>
+  static MATRIX_KERNEL void run(const U *sp, std::size_t ss0, std::size_t ss1,
+                                T *dp, std::size_t ds0, std::size_t ds1,
+                                std::size_t ni, std::size_t nj) {
+    for (std::size_t i = 0; i != ni; ++i)
+      for (std::size_t j = 0; j != nj; ++j)
+        dp[i * ds0 + j * ds1] = sp[i * ss0 + j * ss1];
+  }
+};
+
+template <std::size_t D, std::size_t N, typename U, typename T>
+Enable_if<(D + 2 == N), void>
+blocked_copy_dim(const MatrixSlice<N> &sd, const U *sp,
+                 const MatrixSlice<N> &dd, T *dp) {
+  const std::size_t n0 = sd.extents[D], n1 = sd.extents[D + 1];
+  const std::size_t ss0 = sd.strides[D], ss1 = sd.strides[D + 1];
+  const std::size_t ds0 = dd.strides[D], ds1 = dd.strides[D + 1];
+  if (ss1 == 1 && ds1 == 1) { // dense rows on both sides: no need to block
+    for (std::size_t i = 0; i != n0; ++i)
+      convert_n<U, T>::run(sp + i * ss0, dp + i * ds0, n1);
+    return;
+  }
+  for (std::size_t ib = 0; ib < n0; ib += copy_block) {
+    const std::size_t ie = std::min(ib + copy_block, n0);
+    for (std::size_t jb = 0; jb < n1; jb += copy_block) {
+      const std::size_t je = std::min(jb + copy_block, n1);
+      dispatch<copy_block_kernel>(sp + ib * ss0 + jb * ss1, ss0, ss1,
+                                  dp + ib * ds0 + jb * ds1, ds0, ds1, ie - ib,
+                                  je - jb);
+    }
+  }
+}
+
+template <std::size_t D, std::size_t N, typename U, typename T>
+Enable_if<(D + 2 < N), void>
+blocked_copy_dim(const MatrixSlice<N> &sd, const U *sp,
+                 const MatrixSlice<N> &dd, T *dp) {
+  for (std::size_t i = 0; i != sd.extents[D]; ++i)
+    blocked_copy_dim<D + 1>(sd, sp + i * sd.strides[D], dd,
+                            dp + i * dd.strides[D]);
+}
+
+// Copy the elements described by (sd, sp) into the ones described by
+// (dd, dp). Both slices must have the same extents but may have any strides,
+// so this is the kernel behind every conversion between layouts and views.
+// Identical dense layouts degenerate into a flat copy and dense rows into row
+// copies, both through convert_n; otherwise the two innermost dimensions are
+// walked in square blocks so that a transposing copy touches both sides
+// within cache.
+template <std::size_t N, typename U, typename T>
+Enable_if<(N >= 2), void> blocked_copy(const MatrixSlice<N> &sd, const U *sp,
+                                       const MatrixSlice<N> &dd, T *dp) {
+  assert(same_extents(sd, dd));
+  if (sd.strides == dd.strides && is_contiguous(sd)) {
+    convert_n<U, T>::run(sp + sd.start, dp + dd.start, sd.size);
+    return;
+  }
+  blocked_copy_dim<0>(sd, sp + sd.start, dd, dp + dd.start);
+}
+
+template <std::size_t N, typename U, typename T>
+Enable_if<(N == 1), void> blocked_copy(const MatrixSlice<N> &sd, const U *sp,
+                                       const MatrixSlice<N> &dd, T *dp) {
+  assert(same_extents(sd, dd));
+  sp += sd.start;
+  dp += dd.start;
+  if (sd.strides[0] == 1 && dd.strides[0] == 1) {
+    convert_n<U, T>::run(sp, dp, sd.extents[0]);
+    return;
+  }
+  for (std::size_t i = 0; i != sd.extents[0]; ++i)
+    dp[i * dd.strides[0]] = sp[i * sd.strides[0]];
+}
+
+// Z-order (Morton) code of a 2-D position: the bits of i and j interleaved
+inline std::size_t morton_encode(std::size_t i, std::size_t j) {
+  std::size_t code = 0;
+  for (std::size_t b = 0; b != 4 * sizeof(std::size_t); ++b) {
+    code |= ((i >> b) & 1) << (2 * b + 1);
+    code |= ((j >> b) & 1) << (2 * b);
+  }
+  return code;
+}
+
 } // namespace matrix_impl
 
 template <typename T, std::size_t N>
@@ -0,0 +1,405 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dispatch.hpp"
+#include "half.hpp"
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+// Arithmetic on whole matrices. Every kernel reads its operands in chunks,
+// converts them to the accumulator type of the element (float for half and
+// bfloat16, the type itself otherwise) and converts the results back only
+// when it stores them, so reduced precision matrices move half the bytes of
+// float ones while computing in float. The inner loops are dispatched
+// kernels (see dispatch.hpp).
+
+namespace ops_impl {
+template <typename M>
+using Value = typename std::remove_const<typename M::value_type>::type;
+
+// Elements converted per chunk: the chunk buffers of a kernel stay in L1
+constexpr std::size_t chunk = 256;
+
+// Elements per parallel task in the element-wise kernels and reductions
+constexpr std::size_t grain = 32768;
+
+// out[k] = A(p[k * s]), and its inverse
+template <typename U, typename A>
+void load(const U *p, std::size_t s, std::size_t n, A *out) {
+  if (s == 1)
+    matrix_impl::convert_n<U, A>::run(p, out, n);
+  else
+    for (std::size_t k = 0; k != n; ++k)
+      out[k] = A(p[k * s]);
+}
+
+template <typename A, typename T>
+void store(const A *in, std::size_t n, T *p, std::size_t s) {
+  if (s == 1)
+    matrix_impl::convert_n<A, T>::run(in, p, n);
+  else
+    for (std::size_t k = 0; k != n; ++k)
+      p[k * s] = T(in[k]);
+}
+
+// Sum with independent partial sums, which the compiler can keep in vector
+// registers without reassociating the floating point additions itself
+struct sum_kernel {
+  template <typename A> static MATRIX_KERNEL A run(const A *x, std::size_t n) {
+    A acc[8] = {};
+    std::size_t k = 0;
+    for (; k + 8 <= n; k += 8)
+      for (std::size_t l = 0; l != 8; ++l)
+        acc[l] += x[k + l];
+    for (; k != n; ++k)
+      acc[0] += x[k];
+    return ((acc[0] + acc[1]) + (acc[2] + acc[3])) +
+           ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+  }
+};
+
+struct dot_kernel {
+  template <typename A>
+  static MATRIX_KERNEL A run(const A *x, const A *y, std::size_t n) {
+    A acc[8] = {};
+    std::size_t k = 0;
+    for (; k + 8 <= n; k += 8)
+      for (std::size_t l = 0; l != 8; ++l)
+        acc[l] += x[k + l] * y[k + l];
+    for (; k != n; ++k)
+      acc[0] += x[k] * y[k];
+    return ((acc[0] + acc[1]) + (acc[2] + acc[3])) +
+           ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+  }
+};
+
+// z = f(x) over a chunk
+struct map1_kernel {
+  template <typename F, typename A>
+  static MATRIX_KERNEL void run(F f, const A *x, A *z, std::size_t n) {
+    for (std::size_t k = 0; k != n; ++k)
+      z[k] = f(x[k]);
+  }
+};
+
+// z = f(x, y) over a chunk
+struct map2_kernel {
+  template <typename F, typename A>
+  static MATRIX_KERNEL void run(F f, const A *x, const A *y, A *z,
+                                std::size_t n) {
+    for (std::size_t k = 0; k != n; ++k)
+      z[k] = f(x[k], y[k]);
+  }
+};
+
+// Run f(x, n) over the chunks of (ad, ap) converted to A, in parallel, and
+// combine the per-task results with +
+template <typename A, std::size_t N, typename U, typename F>
+A reduce(const MatrixSlice<N> &ad, const U *ap, F f) {
+  const std::size_t lines = matrix_impl::line_count(ad);
+  const std::size_t len = ad.extents[N - 1];
+  if (lines == 0)
+    return A{};
+  const std::size_t tasks = std::max<std::size_t>(
+      1, std::min(matrix_impl::thread_count(), ad.size / grain));
+  std::vector<A> part(tasks, A{});
+  matrix_impl::parallel_tasks(tasks, [&](std::size_t t) {
+    A x[chunk];
+    for (std::size_t l = lines * t / tasks; l != lines * (t + 1) / tasks;
+         ++l) {
+      const U *a = ap + matrix_impl::line_offset(ad, l);
+      for (std::size_t k = 0; k < len; k += chunk) {
+        const std::size_t n = std::min(chunk, len - k);
+        load(a + k * ad.strides[N - 1], ad.strides[N - 1], n, x);
+        part[t] += f(x, n);
+      }
+    }
+  });
+  return sum_kernel::run(part.data(), part.size());
+}
+
+// The same over matching chunks of (ad, ap) and (bd, bp): f(x, y, n)
+template <typename A, std::size_t N, typename U, typename V, typename F>
+A reduce2(const MatrixSlice<N> &ad, const U *ap, const MatrixSlice<N> &bd,
+          const V *bp, F f) {
+  const std::size_t lines = matrix_impl::line_count(ad);
+  const std::size_t len = ad.extents[N - 1];
+  if (lines == 0)
+    return A{};
+  const std::size_t tasks = std::max<std::size_t>(
+      1, std::min(matrix_impl::thread_count(), ad.size / grain));
+  std::vector<A> part(tasks, A{});
+  matrix_impl::parallel_tasks(tasks, [&](std::size_t t) {
+    A x[chunk], y[chunk];
+    for (std::size_t l = lines * t / tasks; l != lines * (t + 1) / tasks;
+         ++l) {
+      const U *a = ap + matrix_impl::line_offset(ad, l);
+      const V *b = bp + matrix_impl::line_offset(bd, l);
+      for (std::size_t k = 0; k < len; k += chunk) {
+        const std::size_t n = std::min(chunk, len - k);
+        load(a + k * ad.strides[N - 1], ad.strides[N - 1], n, x);
+        load(b + k * bd.strides[N - 1], bd.strides[N - 1], n, y);
+        part[t] += f(x, y, n);
+      }
+    }
+  });
+  return sum_kernel::run(part.data(), part.size());
+}
+
+// (od, op) = f(a) element by element, with f applied to chunks converted to
+// A: f(x, z, n) writes z[0..n)
+template <typename A, std::size_t N, typename U, typename T, typename F>
+void map(const MatrixSlice<N> &ad, const U *ap, const MatrixSlice<N> &od,
+         T *op, F f) {
+  const std::size_t lines = matrix_impl::line_count(ad);
+  const std::size_t len = ad.extents[N - 1];
+  matrix_impl::parallel_for(
+      0, lines, std::max<std::size_t>(1, grain / std::max<std::size_t>(len, 1)),
+      [&](std::size_t first, std::size_t last) {
+        A x[chunk], z[chunk];
+        for (std::size_t l = first; l != last; ++l) {
+          const U *a = ap + matrix_impl::line_offset(ad, l);
+          T *o = op + matrix_impl::line_offset(od, l);
+          for (std::size_t k = 0; k < len; k += chunk) {
+            const std::size_t n = std::min(chunk, len - k);
+            load(a + k * ad.strides[N - 1], ad.strides[N - 1], n, x);
+            f(x, z, n);
+            store(z, n, o + k * od.strides[N - 1], od.strides[N - 1]);
+          }
+        }
+      });
+}
+
+// The same for two operands: f(x, y, z, n)
+template <typename A, std::size_t N, typename U, typename V, typename T,
+          typename F>
+void zip(const MatrixSlice<N> &ad, const U *ap, const MatrixSlice<N> &bd,
+         const V *bp, const MatrixSlice<N> &od, T *op, F f) {
+  const std::size_t lines = matrix_impl::line_count(ad);
+  const std::size_t len = ad.extents[N - 1];
+  matrix_impl::parallel_for(
+      0, lines, std::max<std::size_t>(1, grain / std::max<std::size_t>(len, 1)),
+      [&](std::size_t first, std::size_t last) {
+        A x[chunk], y[chunk], z[chunk];
+        for (std::size_t l = first; l != last; ++l) {
+          const U *a = ap + matrix_impl::line_offset(ad, l);
+          const V *b = bp + matrix_impl::line_offset(bd, l);
+          T *o = op + matrix_impl::line_offset(od, l);
+          for (std::size_t k = 0; k < len; k += chunk) {
+            const std::size_t n = std::min(chunk, len - k);
+            load(a + k * ad.strides[N - 1], ad.strides[N - 1], n, x);
+            load(b + k * bd.strides[N - 1], bd.strides[N - 1], n, y);
+            f(x, y, z, n);
+            store(z, n, o + k * od.strides[N - 1], od.strides[N - 1]);
+          }
+        }
+      });
+}
+
+// out = f(x) elementwise, as a Matrix with the element type of x
+template <typename M, typename F>
+Matrix<Value<M>, M::order()> transform(const M &x, F f) {
+  using A = Accumulator<Value<M>>;
+  Matrix<Value<M>, M::order()> out(x.descriptor().extents);
+  map<A>(x.descriptor(), x.data(), out.descriptor(), out.data(),
+         [&](const A *a, A *c, std::size_t n) {
+           matrix_impl::dispatch<map1_kernel>(f, a, c, n);
+         });
+  return out;
+}
+
+// out = f(x, y) elementwise, as a Matrix with the element type of x
+template <typename M1, typename M2, typename F>
+Matrix<Value<M1>, M1::order()> combine(const M1 &x, const M2 &y, F f) {
+  static_assert(M1::order() == M2::order(), "matrix ops: order mismatch");
+  assert(same_extents(x.descriptor(), y.descriptor()));
+  using A = Accumulator<Value<M1>>;
+  Matrix<Value<M1>, M1::order()> out(x.descriptor().extents);
+  zip<A>(x.descriptor(), x.data(), y.descriptor(), y.data(), out.descriptor(),
+         out.data(), [&](const A *a, const A *b, A *c, std::size_t n) {
+           matrix_impl::dispatch<map2_kernel>(f, a, b, c, n);
+         });
+  return out;
+}
+
+// Panel sizes of multiply: a kc x nc panel of b, converted once, stays in L2
+// while every row of a streams past it
+constexpr std::size_t gemm_kc = 128;
+constexpr std::size_t gemm_nc = 256;
+
+// c(r, j) += sum_p x(r, p) panel(p, j) for four rows r of c, ldc apart, and
+// the four rows of x packed gemm_kc apart
+struct gemm4_kernel {
+  template <typename A>
+  static MATRIX_KERNEL void run(const A *x, const A *panel, std::size_t kb,
+                                std::size_t nb, A *c, std::size_t ldc) {
+    A *c0 = c, *c1 = c0 + ldc, *c2 = c1 + ldc, *c3 = c2 + ldc;
+    for (std::size_t p = 0; p != kb; ++p) {
+      const A x0 = x[p], x1 = x[gemm_kc + p];
+      const A x2 = x[2 * gemm_kc + p], x3 = x[3 * gemm_kc + p];
+      const A *b = panel + p * nb;
+      for (std::size_t j = 0; j != nb; ++j) {
+        c0[j] += x0 * b[j];
+        c1[j] += x1 * b[j];
+        c2[j] += x2 * b[j];
+        c3[j] += x3 * b[j];
+      }
+    }
+  }
+};
+
+// The same for a single row
+struct gemm1_kernel {
+  template <typename A>
+  static MATRIX_KERNEL void run(const A *x, const A *panel, std::size_t kb,
+                                std::size_t nb, A *c) {
+    for (std::size_t p = 0; p != kb; ++p) {
+      const A xp = x[p];
+      const A *b = panel + p * nb;
+      for (std::size_t j = 0; j != nb; ++j)
+        c[j] += xp * b[j];
+    }
+  }
+};
+} // namespace ops_impl
+
+//! The transpose of a 2-D matrix, as a new row-major Matrix. The copy runs
+//! in square blocks, see matrix_impl::blocked_copy.
+template <typename M>
+Enable_if<Matrix_type<M>(), Matrix<ops_impl::Value<M>, 2>>
+transpose(const M &m) {
+  MATRIX_TIMED("transpose");
+  static_assert(M::order() == 2, "transpose: only 2-D matrices");
+  Matrix<ops_impl::Value<M>, 2> t(m.n_cols(), m.n_rows());
+  MatrixSlice<2> td = t.descriptor(); // t seen with the extents of m
+  std::swap(td.extents[0], td.extents[1]);
+  std::swap(td.strides[0], td.strides[1]);
+  matrix_impl::blocked_copy(m.descriptor(), m.data(), td, t.data());
+  return t;
+}
+
+//! Element-wise sum and difference of two matrices of the same extents
+///@{
+template <typename M1, typename M2>
+Enable_if<Matrix_type<M1>() && Matrix_type<M2>(),
+          Matrix<ops_impl::Value<M1>, M1::order()>>
+operator+(const M1 &a, const M2 &b) {
+  MATRIX_TIMED("add");
+  using A = Accumulator<ops_impl::Value<M1>>;
+  return ops_impl::combine(a, b, [](A x, A y) { return x + y; });
+}
+
+template <typename M1, typename M2>
+Enable_if<Matrix_type<M1>() && Matrix_type<M2>(),
+          Matrix<ops_impl::Value<M1>, M1::order()>>
+operator-(const M1 &a, const M2 &b) {
+  MATRIX_TIMED("subtract");
+  using A = Accumulator<ops_impl::Value<M1>>;
+  return ops_impl::combine(a, b, [](A x, A y) { return x - y; });
+}
+///@}
+
+//! Every element of m scaled by s
+///@{
+template <typename M>
+Enable_if<Matrix_type<M>(), Matrix<ops_impl::Value<M>, M::order()>>
+operator*(const M &m, const Accumulator<ops_impl::Value<M>> &s) {
+  MATRIX_TIMED("scale");
+  using A = Accumulator<ops_impl::Value<M>>;
+  return ops_impl::transform(m, [s](A x) { return x * s; });
+}
+
+template <typename M>
+Enable_if<Matrix_type<M>(), Matrix<ops_impl::Value<M>, M::order()>>
+operator*(const Accumulator<ops_impl::Value<M>> &s, const M &m) {
+  return m * s;
+}
+///@}
+
+//! Sum of all the elements, accumulated in Accumulator<value_type>
+template <typename M>
+Enable_if<Matrix_type<M>(), Accumulator<ops_impl::Value<M>>> sum(const M &m) {
+  MATRIX_TIMED("sum");
+  using A = Accumulator<ops_impl::Value<M>>;
+  return ops_impl::reduce<A>(m.descriptor(), m.data(),
+                             [](const A *x, std::size_t n) {
+                               return matrix_impl::dispatch<
+                                   ops_impl::sum_kernel>(x, n);
+                             });
+}
+
+//! Sum of the products of the corresponding elements of a and b
+template <typename M1, typename M2>
+Enable_if<Matrix_type<M1>() && Matrix_type<M2>(),
+          Accumulator<ops_impl::Value<M1>>>
+dot(const M1 &a, const M2 &b) {
+  MATRIX_TIMED("dot");
+  static_assert(M1::order() == M2::order(), "dot: order mismatch");
+  assert(same_extents(a.descriptor(), b.descriptor()));
+  using A = Accumulator<ops_impl::Value<M1>>;
+  return ops_impl::reduce2<A>(
+      a.descriptor(), a.data(), b.descriptor(), b.data(),
+      [](const A *x, const A *y, std::size_t n) {
+        return matrix_impl::dispatch<ops_impl::dot_kernel>(x, y, n);
+      });
+}
+
+//! The matrix product a b, computed and returned in the accumulator type.
+//! Panels of b are converted once into a dense buffer and four rows of a are
+//! combined with each of its rows at a time; rows of the result are split
+//! between the threads.
+template <typename M1, typename M2>
+Enable_if<Matrix_type<M1>() && Matrix_type<M2>(),
+          Matrix<Accumulator<ops_impl::Value<M1>>, 2>>
+multiply(const M1 &a, const M2 &b) {
+  MATRIX_TIMED("multiply");
+  static_assert(M1::order() == 2 && M2::order() == 2,
+                "multiply: both operands must be 2-D");
+  using A = Accumulator<ops_impl::Value<M1>>;
+  using ops_impl::gemm_kc;
+  using ops_impl::gemm_nc;
+  const std::size_t m = a.n_rows(), k = a.n_cols(), n = b.n_cols();
+  assert(b.n_rows() == k);
+
+  const MatrixSlice<2> &ad = a.descriptor(), &bd = b.descriptor();
+  const auto *ap = a.data() + ad.start;
+  const auto *bp = b.data() + bd.start;
+  Matrix<A, 2> c(m, n);
+  A *cp = c.data();
+
+  matrix_impl::parallel_for(0, m, 16, [&](std::size_t i0, std::size_t i1) {
+    std::vector<A> panel(gemm_kc * gemm_nc), arow(4 * gemm_kc);
+    for (std::size_t jb = 0; jb < n; jb += gemm_nc) {
+      const std::size_t nb = std::min(gemm_nc, n - jb);
+      for (std::size_t pb = 0; pb < k; pb += gemm_kc) {
+        const std::size_t kb = std::min(gemm_kc, k - pb);
+        for (std::size_t p = 0; p != kb; ++p)
+          ops_impl::load(bp + (pb + p) * bd.strides[0] + jb * bd.strides[1],
+                         bd.strides[1], nb, panel.data() + p * nb);
+
+        std::size_t i = i0;
+        for (; i + 4 <= i1; i += 4) {
+          for (std::size_t r = 0; r != 4; ++r)
+            ops_impl::load(ap + (i + r) * ad.strides[0] + pb * ad.strides[1],
+                           ad.strides[1], kb, arow.data() + r * gemm_kc);
+          matrix_impl::dispatch<ops_impl::gemm4_kernel>(
+              arow.data(), panel.data(), kb, nb, cp + i * n + jb, n);
+        }
+        for (; i != i1; ++i) {
+          ops_impl::load(ap + i * ad.strides[0] + pb * ad.strides[1],
+                         ad.strides[1], kb, arow.data());
+          matrix_impl::dispatch<ops_impl::gemm1_kernel>(
+              arow.data(), panel.data(), kb, nb, cp + i * n + jb);
+        }
+      }
+    }
+  });
+  return c;
+}
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cassert>
 #include <cstddef>
+#include <iterator>
+#include <type_traits>
 
 #include "matrix_base.hpp"
 #include "matrix_fwd.hpp"
@@ -30,10 +33,14 @@ public:
   //! assign from MatrixRef
   template <typename U> MatrixRef &operator=(const MatrixRef<U, N> &x);
 
-  //! construct from Matrix
-  template <typename U> MatrixRef(const Matrix<U, N> &);
+  //! construct from Matrix (any strided layout)
+  ///@{
+  template <typename U, typename L> MatrixRef(Matrix<U, N, L> &);
+  template <typename U, typename L> MatrixRef(const Matrix<U, N, L> &);
+  ///@}
   //! assign from Matrix
-  template <typename U> MatrixRef &operator=(const Matrix<U, N> &);
+  template <typename U, typename L>
+  MatrixRef &operator=(const Matrix<U, N, L> &);
 
   //! assign from list
   MatrixRef &operator=(MatrixInitializer<T, N>);
@@ -121,6 +128,52 @@ public:
   Enable_if<Matrix_type<M>(), MatrixRef &> apply(const M &m, F f);
 };
 
+// Walks the elements of a MatrixRef in logical order (last index fastest),
+// whatever the strides of the underlying slice
+template <typename T, std::size_t N> class MatrixRefIterator {
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = typename std::remove_const<T>::type;
+  using difference_type = std::ptrdiff_t;
+  using pointer = T *;
+  using reference = T &;
+
+  MatrixRefIterator(const MatrixSlice<N> &s, T *base, bool limit = false)
+      : desc_(s), ptr_(base + s.start), pos_(limit ? s.size : 0) {
+    std::fill(index_.begin(), index_.end(), 0);
+  }
+
+  reference operator*() const { return *ptr_; }
+  pointer operator->() const { return ptr_; }
+
+  MatrixRefIterator &operator++() {
+    ++pos_;
+    for (std::size_t d = N - 1;; --d) {
+      ptr_ += desc_.strides[d];
+      if (++index_[d] != desc_.extents[d] || d == 0)
+        break;
+      ptr_ -= index_[d] * desc_.strides[d];
+      index_[d] = 0;
+    }
+    return *this;
+  }
+
+  MatrixRefIterator operator++(int) {
+    MatrixRefIterator tmp(*this);
+    ++*this;
+    return tmp;
+  }
+
+  bool operator==(const MatrixRefIterator &x) const { return pos_ == x.pos_; }
+  bool operator!=(const MatrixRefIterator &x) const { return pos_ != x.pos_; }
+
+private:
+  MatrixSlice<N> desc_;
+  std::array<std::size_t, N> index_; // current position in each dimension
+  T *ptr_;
+  std::size_t pos_; // number of elements already visited
+};
+
 template <typename T, std::size_t N>
 MatrixRef<T, N> &MatrixRef<T, N>::operator=(MatrixRef &&x) {
   assert(same_extents(this->desc_, x.desc_));
@@ -132,7 +185,7 @@ MatrixRef<T, N> &MatrixRef<T, N>::operator=(MatrixRef &&x) {
 template <typename T, std::size_t N>
 MatrixRef<T, N> &MatrixRef<T, N>::operator=(const MatrixRef &x) {
   assert(same_extents(this->desc_, x.desc_));
-  std::copy(x.begin(), x.end(), begin());
+  matrix_impl::blocked_copy(x.desc_, x.data(), this->desc_, data());
 
   return *this;
 }
@@ -148,22 +201,28 @@ MatrixRef<T, N> &MatrixRef<T, N>::operator=(const MatrixRef<U, N> &x) {
   static_assert(Convertible<U, T>(), "MatrixRef =: incompatible element types");
   assert(this->desc_.extents == x.descriptor().extents);
 
-  std::copy(x.begin(), x.end(), begin());
+  matrix_impl::blocked_copy(x.descriptor(), x.data(), this->desc_, data());
   return *this;
 }
 
 template <typename T, std::size_t N>
-template <typename U>
-MatrixRef<T, N>::MatrixRef(const Matrix<U, N> &x)
+template <typename U, typename L>
+MatrixRef<T, N>::MatrixRef(Matrix<U, N, L> &x)
     : MatrixBase<T, N>{x.descriptor()}, ptr_(x.data()) {}
 
 template <typename T, std::size_t N>
-template <typename U>
-MatrixRef<T, N> &MatrixRef<T, N>::operator=(const Matrix<U, N> &x) {
+template <typename U, typename L>
+MatrixRef<T, N>::MatrixRef(const Matrix<U, N, L> &x)
+    : MatrixBase<T, N>{x.descriptor()}, ptr_(x.data()) {}
+
+template <typename T, std::size_t N>
+template <typename U, typename L>
+MatrixRef<T, N> &MatrixRef<T, N>::operator=(const Matrix<U, N, L> &x) {
   static_assert(Convertible<U, T>(), "MatrixRef =: incompatible element types");
   assert(this->desc_.extents == x.descriptor().extents);
 
-  std::copy(x.begin(), x.end(), begin());
+  // x may use another layout, so copy by index rather than in storage order
+  matrix_impl::blocked_copy(x.descriptor(), x.data(), this->desc_, data());
   return *this;
 }
 
@@ -218,7 +277,7 @@ MatrixRef<const T, N - 1> MatrixRef<T, N>::row(size_t n) const {
 // col
 template <typename T, size_t N>
 MatrixRef<T, N - 1> MatrixRef<T, N>::col(size_t n) {
-  assert(n < this->cols());
+  assert(n < this->n_cols());
   MatrixSlice<N - 1> col;
   matrix_impl::slice_dim<1>(n, this->desc_, col);
   return {col, ptr_};
@@ -226,7 +285,7 @@ MatrixRef<T, N - 1> MatrixRef<T, N>::col(size_t n) {
 
 template <typename T, size_t N>
 MatrixRef<const T, N - 1> MatrixRef<T, N>::col(size_t n) const {
-  assert(n < this->cols());
+  assert(n < this->n_cols());
   MatrixSlice<N - 1> col;
   matrix_impl::slice_dim<1>(n, this->desc_, col);
   return {col, ptr_};
@@ -245,6 +304,7 @@ MatrixRef<T, N> MatrixRef<T, N>::rows(std::size_t i, std::size_t j) {
     d.start += matrix_impl::do_slice_dim2(this->desc_, d, slice{0}, NRest);
     --NRest;
   }
+  d.size = matrix_impl::compute_size(d.extents);
   return {d, data()};
 }
 
@@ -262,6 +322,7 @@ MatrixRef<const T, N> MatrixRef<T, N>::rows(std::size_t i,
     d.start += matrix_impl::do_slice_dim2(this->desc_, d, slice{0}, NRest);
     --NRest;
   }
+  d.size = matrix_impl::compute_size(d.extents);
   return {d, data()};
 }
 
@@ -282,6 +343,7 @@ MatrixRef<T, N> MatrixRef<T, N>::cols(std::size_t i, std::size_t j) {
     d.start += matrix_impl::do_slice_dim2(this->desc_, d, slice{0}, NRest);
     --NRest;
   }
+  d.size = matrix_impl::compute_size(d.extents);
   return {d, data()};
 }
 
@@ -303,6 +365,7 @@ MatrixRef<const T, N> MatrixRef<T, N>::cols(std::size_t i,
     d.start += matrix_impl::do_slice_dim2(this->desc_, d, slice{0}, NRest);
     --NRest;
   }
+  d.size = matrix_impl::compute_size(d.extents);
   return {d, data()};
 }
 
@@ -319,7 +382,9 @@ template <typename M, typename F>
 Enable_if<Matrix_type<M>(), MatrixRef<T, N> &>
 MatrixRef<T, N>::apply(const M &m, F f) {
   assert(same_extents(this->desc_, m.descriptor()));
-  auto j = m.begin();
+  // walk m through a view so that its layout does not matter
+  MatrixRef<const typename M::value_type, N> other(m.descriptor(), m.data());
+  auto j = other.begin();
   for (auto i = begin(); i != end(); ++i) {
     f(*i, *j);
     ++j;
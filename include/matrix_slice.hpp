@@ -1,10 +1,22 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <cstddef>
+#include <numeric>
 
 #include "matrix_impl.hpp"
 
+// matrix_impl.hpp and this header include each other, so declare what the
+// slice needs in case matrix_impl.hpp was the one included first
+namespace matrix_impl {
+template <size_t N>
+size_t compute_strides(const std::array<size_t, N> &extents,
+                       std::array<size_t, N> &strides);
+template <size_t N> size_t compute_size(const std::array<size_t, N> &extents);
+} // namespace matrix_impl
+
 template <size_t N> struct MatrixSlice {
   size_t size;                   // total number of elements
   size_t start;                  // index of first element
@@ -17,26 +29,21 @@ template <size_t N> struct MatrixSlice {
   };
 
   MatrixSlice(size_t s, std::initializer_list<size_t> exts) : start{s} {
-    static_assert(exts.size() == N, "Error: wrong number of extents");
+    assert(exts.size() == N && "Error: wrong number of extents");
     std::copy(exts.begin(), exts.end(), extents.begin());
     size = matrix_impl::compute_strides(extents, strides);
   }
 
   MatrixSlice(size_t s, std::initializer_list<size_t> exts,
-              std::initializer_list<size_t> strs) {
-    static_assert(exts.size() == N, "Error: wrong number of extents");
-    static_assert(strs.size() == N, "Error: wrong number of strides");
+              std::initializer_list<size_t> strs)
+      : start{s} {
+    assert(exts.size() == N && "Error: wrong number of extents");
+    assert(strs.size() == N && "Error: wrong number of strides");
     std::copy(exts.begin(), exts.end(), extents.begin());
     std::copy(strs.begin(), strs.end(), strides.begin());
     size = matrix_impl::compute_size(extents);
   }
 
-  MatrixSlice(size_t s, const std::initializer_list<size_t> &exts)
-      : start{s}, extents{exts} {
-    static_assert(exts.size() == N, "Error: wrong number of extents");
-    size = matrix_impl::compute_strides(extents, strides);
-  }
-
   template <typename... Dims>
   MatrixSlice(Dims... dims) : start{0}, extents{size_t(dims)...} {
     static_assert(sizeof...(Dims) == N, "Error: wrong number of dimensions");
@@ -50,3 +57,8 @@ template <size_t N> struct MatrixSlice {
     return std::inner_product(args, args + N, strides.begin(), start);
   }
 };
+
+template <size_t N>
+bool same_extents(const MatrixSlice<N> &a, const MatrixSlice<N> &b) {
+  return a.extents == b.extents;
+}
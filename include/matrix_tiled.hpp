@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "contiguous_ref.hpp"
+#include "instrument.hpp"
+#include "layout.hpp"
+#include "matrix_fwd.hpp"
+#include "matrix_impl.hpp"
+#include "matrix_ref.hpp"
+#include "matrix_slice.hpp"
+
+// 2-D Matrix stored as B x B tiles ordered along a Z-order curve. Each tile is
+// a dense row-major block, so a tile is a ContiguousRef and 2-D
+// neighbourhoods stay within a few cache lines. Tiles on the last row/column
+// are clipped to the matrix, so the storage holds exactly rows * cols
+// elements. Rows and columns cross tiles and cannot be expressed as strided
+// views; copy into a strided Matrix when those are needed.
+template <typename T, std::size_t B>
+class Matrix<T, 2, tiled<B>> {
+public:
+  //! @cond Doxygen_Suppress
+  static constexpr size_t order_ = 2;
+  using value_type = T;
+  using iterator = typename std::vector<T>::iterator;
+  using const_iterator = typename std::vector<T>::const_iterator;
+
+  Matrix() : rows_{0}, cols_{0}, tile_rows_{0}, tile_cols_{0} {}
+  Matrix(Matrix &&) = default; // move
+  Matrix &operator=(Matrix &&) = default;
+  Matrix(const Matrix &x) // copy
+      : rows_{x.rows_}, cols_{x.cols_}, tile_rows_{x.tile_rows_},
+        tile_cols_{x.tile_cols_}, offsets_(x.offsets_), elems_(x.elems_) {
+    instrument_impl::note_growth(elems_, 0);
+    instrument_impl::note_copy(elems_.size() * sizeof(T));
+  }
+  Matrix &operator=(const Matrix &x) {
+    Matrix tmp(x);
+    return *this = std::move(tmp);
+  }
+  ~Matrix() = default;
+  //! @endcond
+
+  //! specify the extents
+  Matrix(std::size_t rows, std::size_t cols) { set_extents(rows, cols); }
+
+  //! construct from a strided Matrix or MatrixRef, one tile at a time
+  template <typename M, typename = Enable_if<Matrix_type<M>()>>
+  Matrix(const M &x) {
+    static_assert(M::order() == 2, "tiled Matrix: order mismatch");
+    static_assert(Convertible<typename M::value_type, T>(), "");
+    set_extents(x.n_rows(), x.n_cols());
+    copy_from(x.descriptor(), x.data());
+  }
+
+  //! assign from a strided Matrix or MatrixRef
+  template <typename M, typename = Enable_if<Matrix_type<M>()>>
+  Matrix &operator=(const M &x) {
+    static_assert(M::order() == 2, "tiled Matrix: order mismatch");
+    static_assert(Convertible<typename M::value_type, T>(), "");
+    set_extents(x.n_rows(), x.n_cols());
+    copy_from(x.descriptor(), x.data());
+    return *this;
+  }
+
+  //! number of dimensions
+  static constexpr std::size_t order() { return order_; }
+
+  //! #elements in the nth dimension
+  std::size_t extent(std::size_t n) const {
+    assert(n < order_);
+    return n == 0 ? rows_ : cols_;
+  }
+
+  std::size_t n_rows() const { return rows_; }
+  std::size_t n_cols() const { return cols_; }
+
+  //! total number of elements
+  std::size_t size() const { return elems_.size(); }
+
+  //! "flat" element access, in storage (tile) order
+  ///@{
+  T *data() { return elems_.data(); }
+  const T *data() const { return elems_.data(); }
+  ///@}
+
+  //! m(i, j) subscripting
+  ///@{
+  T &operator()(std::size_t i, std::size_t j) {
+    assert(i < rows_ && j < cols_);
+    return elems_[offset(i, j)];
+  }
+  const T &operator()(std::size_t i, std::size_t j) const {
+    assert(i < rows_ && j < cols_);
+    return elems_[offset(i, j)];
+  }
+  ///@}
+
+  //! number of tiles along each dimension
+  std::size_t n_tile_rows() const { return tile_rows_; }
+  std::size_t n_tile_cols() const { return tile_cols_; }
+
+  //! the (ti, tj) tile as a dense view
+  ///@{
+  ContiguousRef<T, 2> tile(std::size_t ti, std::size_t tj) {
+    return {tile_slice(ti, tj), data()};
+  }
+  ContiguousRef<const T, 2> tile(std::size_t ti, std::size_t tj) const {
+    return {tile_slice(ti, tj), data()};
+  }
+  ///@}
+
+  //! copy every element into the view described by (d, p)
+  template <typename U> void copy_to(const MatrixSlice<2> &d, U *p) const {
+    assert(d.extents[0] == rows_ && d.extents[1] == cols_);
+    for (std::size_t ti = 0; ti != tile_rows_; ++ti)
+      for (std::size_t tj = 0; tj != tile_cols_; ++tj)
+        matrix_impl::blocked_copy(tile_slice(ti, tj), data(),
+                                  block_slice(d, ti, tj), p);
+  }
+
+  //! element iterators, in storage (tile) order
+  ///@{
+  iterator begin() { return elems_.begin(); }
+  const_iterator begin() const { return elems_.cbegin(); }
+  iterator end() { return elems_.end(); }
+  const_iterator end() const { return elems_.cend(); }
+  ///@}
+
+  //! f(x) for every element x, in storage order
+  template <typename F> Matrix &apply(F f) {
+    for (auto &x : elems_)
+      f(x);
+    return *this;
+  }
+
+private:
+  std::size_t rows_, cols_;
+  std::size_t tile_rows_, tile_cols_;
+  std::vector<std::size_t> offsets_; // first element of each tile, row-major
+  std::vector<T> elems_;
+
+  // width of the tiles in tile column tj (the last one may be clipped)
+  std::size_t tile_width(std::size_t tj) const {
+    return tj + 1 < tile_cols_ ? B : cols_ - tj * B;
+  }
+  std::size_t tile_height(std::size_t ti) const {
+    return ti + 1 < tile_rows_ ? B : rows_ - ti * B;
+  }
+
+  std::size_t offset(std::size_t i, std::size_t j) const {
+    const std::size_t tj = j / B;
+    return offsets_[(i / B) * tile_cols_ + tj] + (i % B) * tile_width(tj) +
+           j % B;
+  }
+
+  MatrixSlice<2> tile_slice(std::size_t ti, std::size_t tj) const {
+    assert(ti < tile_rows_ && tj < tile_cols_);
+    const std::size_t w = tile_width(tj);
+    return {offsets_[ti * tile_cols_ + tj], {tile_height(ti), w}, {w, 1}};
+  }
+
+  // the part of the strided view d covered by tile (ti, tj)
+  MatrixSlice<2> block_slice(const MatrixSlice<2> &d, std::size_t ti,
+                             std::size_t tj) const {
+    return {d.start + ti * B * d.strides[0] + tj * B * d.strides[1],
+            {tile_height(ti), tile_width(tj)},
+            {d.strides[0], d.strides[1]}};
+  }
+
+  template <typename U> void copy_from(const MatrixSlice<2> &d, const U *p) {
+    for (std::size_t ti = 0; ti != tile_rows_; ++ti)
+      for (std::size_t tj = 0; tj != tile_cols_; ++tj)
+        matrix_impl::blocked_copy(block_slice(d, ti, tj), p,
+                                  tile_slice(ti, tj), data());
+    instrument_impl::note_copy(elems_.size() * sizeof(T));
+  }
+
+  // Lay the tiles out along the Z-order curve. The curve is walked only over
+  // the tiles that exist, so no storage is lost to padding.
+  void set_extents(std::size_t rows, std::size_t cols) {
+    rows_ = rows;
+    cols_ = cols;
+    tile_rows_ = (rows + B - 1) / B;
+    tile_cols_ = (cols + B - 1) / B;
+
+    std::vector<std::size_t> order(tile_rows_ * tile_cols_);
+    for (std::size_t t = 0; t != order.size(); ++t)
+      order[t] = t;
+    const std::size_t tc = tile_cols_;
+    std::sort(order.begin(), order.end(), [tc](std::size_t a, std::size_t b) {
+      return matrix_impl::morton_encode(a / tc, a % tc) <
+             matrix_impl::morton_encode(b / tc, b % tc);
+    });
+
+    offsets_.assign(order.size(), 0);
+    std::size_t next = 0;
+    for (std::size_t t : order) {
+      offsets_[t] = next;
+      next += tile_height(t / tc) * tile_width(t % tc);
+    }
+    const std::size_t cap = elems_.capacity();
+    elems_.assign(next, T{});
+    instrument_impl::note_growth(elems_, cap);
+  }
+};
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include "matrix.hpp"
+
+//! which triangle of a square matrix is stored
+enum class triangle { lower, upper };
+
+// Common base of the packed square matrices: only one triangle, diagonal
+// included, is stored, row by row, in n (n + 1) / 2 elements. Row i of the
+// lower triangle holds columns [0, i]; row i of the upper one holds [i, n).
+template <typename T, triangle U> class PackedBase {
+public:
+  static constexpr size_t order_ = 2;
+  using value_type = T;
+  using iterator = typename std::vector<T>::iterator;
+  using const_iterator = typename std::vector<T>::const_iterator;
+
+  PackedBase() : n_{0} {}
+  explicit PackedBase(std::size_t n) : n_{n}, elems_(n * (n + 1) / 2) {}
+
+  //! number of dimensions
+  static constexpr std::size_t order() { return order_; }
+
+  std::size_t n_rows() const { return n_; }
+  std::size_t n_cols() const { return n_; }
+
+  //! number of stored elements
+  std::size_t size() const { return elems_.size(); }
+
+  //! "flat" access to the packed elements
+  ///@{
+  T *data() { return elems_.data(); }
+  const T *data() const { return elems_.data(); }
+  ///@}
+
+  //! true when (i, j) is in the stored triangle
+  static bool stored(std::size_t i, std::size_t j) {
+    return U == triangle::lower ? j <= i : i <= j;
+  }
+
+  //! first column stored in row i
+  std::size_t row_first(std::size_t i) const {
+    return U == triangle::lower ? 0 : i;
+  }
+
+  //! the stored part of row i, columns [row_first(i), ...), as a dense view
+  ///@{
+  MatrixRef<T, 1> row(std::size_t i) {
+    assert(i < n_);
+    return {row_slice(i), data()};
+  }
+  MatrixRef<const T, 1> row(std::size_t i) const {
+    assert(i < n_);
+    return {row_slice(i), data()};
+  }
+  ///@}
+
+  //! packed element iterators, row by row
+  ///@{
+  iterator begin() { return elems_.begin(); }
+  const_iterator begin() const { return elems_.cbegin(); }
+  iterator end() { return elems_.end(); }
+  const_iterator end() const { return elems_.cend(); }
+  ///@}
+
+protected:
+  std::size_t n_;
+  std::vector<T> elems_;
+
+  // O(1) position of the stored element (i, j)
+  std::size_t offset(std::size_t i, std::size_t j) const {
+    assert(stored(i, j) && j < n_);
+    return U == triangle::lower ? i * (i + 1) / 2 + j
+                                : i * (2 * n_ - i - 1) / 2 + j;
+  }
+
+  MatrixSlice<1> row_slice(std::size_t i) const {
+    const std::size_t first = row_first(i);
+    const std::size_t len = U == triangle::lower ? i + 1 : n_ - i;
+    return {offset(i, first), {len}, {1}};
+  }
+
+  // Read the stored triangle of the square matrix x
+  template <typename M> void pack(const M &x) {
+    static_assert(M::order() == 2, "packed matrix: order mismatch");
+    assert(x.n_rows() == x.n_cols());
+    n_ = x.n_rows();
+    elems_.resize(n_ * (n_ + 1) / 2);
+    const MatrixSlice<2> &d = x.descriptor();
+    const typename M::value_type *p = x.data() + d.start;
+    auto out = elems_.begin();
+    for (std::size_t i = 0; i != n_; ++i) {
+      const std::size_t last = U == triangle::lower ? i + 1 : n_;
+      for (std::size_t j = row_first(i); j != last; ++j)
+        *out++ = p[i * d.strides[0] + j * d.strides[1]];
+    }
+  }
+};
+
+//! Triangular matrix: the elements outside the stored triangle are zero
+template <typename T, triangle U = triangle::lower>
+class TriangularMatrix : public PackedBase<T, U> {
+public:
+  TriangularMatrix() = default;
+
+  //! an n x n matrix
+  explicit TriangularMatrix(std::size_t n) : PackedBase<T, U>(n) {}
+
+  //! keep the U triangle of a square Matrix or MatrixRef
+  template <typename M, typename = Enable_if<Matrix_type<M>()>>
+  explicit TriangularMatrix(const M &x) {
+    this->pack(x);
+  }
+
+  //! m(i, j) subscripting; only the stored triangle is writable
+  ///@{
+  T &operator()(std::size_t i, std::size_t j) {
+    return this->elems_[this->offset(i, j)];
+  }
+  T operator()(std::size_t i, std::size_t j) const {
+    assert(i < this->n_ && j < this->n_);
+    return this->stored(i, j) ? this->elems_[this->offset(i, j)] : T{};
+  }
+  ///@}
+
+  //! dense copy, with zeros outside the triangle
+  Matrix<T, 2> to_matrix() const {
+    Matrix<T, 2> m(this->n_, this->n_);
+    for (std::size_t i = 0; i != this->n_; ++i) {
+      auto r = this->row(i);
+      std::copy(r.begin(), r.end(), &m(i, this->row_first(i)));
+    }
+    return m;
+  }
+};
+
+//! Symmetric matrix: m(i, j) and m(j, i) are the same stored element
+template <typename T, triangle U = triangle::lower>
+class SymmetricMatrix : public PackedBase<T, U> {
+public:
+  SymmetricMatrix() = default;
+
+  //! an n x n matrix
+  explicit SymmetricMatrix(std::size_t n) : PackedBase<T, U>(n) {}
+
+  //! keep the U triangle of a square Matrix or MatrixRef, which is assumed
+  //! to be symmetric
+  template <typename M, typename = Enable_if<Matrix_type<M>()>>
+  explicit SymmetricMatrix(const M &x) {
+    this->pack(x);
+  }
+
+  //! m(i, j) subscripting, either triangle
+  ///@{
+  T &operator()(std::size_t i, std::size_t j) {
+    return this->elems_[index(i, j)];
+  }
+  const T &operator()(std::size_t i, std::size_t j) const {
+    return this->elems_[index(i, j)];
+  }
+  ///@}
+
+  //! dense copy with both triangles filled
+  Matrix<T, 2> to_matrix() const {
+    Matrix<T, 2> m(this->n_, this->n_);
+    for (std::size_t i = 0; i != this->n_; ++i) {
+      std::size_t j = this->row_first(i);
+      for (const T &x : this->row(i)) {
+        m(i, j) = x;
+        m(j, i) = x;
+        ++j;
+      }
+    }
+    return m;
+  }
+
+private:
+  std::size_t index(std::size_t i, std::size_t j) const {
+    assert(i < this->n_ && j < this->n_);
+    return this->stored(i, j) ? this->offset(i, j) : this->offset(j, i);
+  }
+};
+
+//! y = a x for a symmetric a. Every stored element is read once and used for
+//! both (i, j) and (j, i).
+template <typename T, triangle U, typename V>
+Enable_if<Matrix_type<V>(), Matrix<T, 1>> symv(const SymmetricMatrix<T, U> &a,
+                                               const V &x) {
+  static_assert(V::order() == 1, "symv: x must be 1-D");
+  const std::size_t n = a.n_rows();
+  assert(x.extent(0) == n);
+
+  const Matrix<T, 1> xd(x); // dense copy, so the inner loops are unit stride
+  const T *xv = xd.data();
+  Matrix<T, 1> y(n);
+  T *yv = y.data();
+
+  for (std::size_t i = 0; i != n; ++i) {
+    const MatrixRef<const T, 1> row = a.row(i);
+    const T *r = row.data() + row.descriptor().start;
+    const std::size_t first = a.row_first(i), len = row.size();
+    const T xi = xv[i];
+    T acc = T{};
+    for (std::size_t k = 0; k != len; ++k) {
+      const std::size_t j = first + k;
+      acc += r[k] * xv[j];
+      if (j != i)
+        yv[j] += r[k] * xi;
+    }
+    yv[i] += acc;
+  }
+  return y;
+}
+
+//! a += alpha x x^T, the symmetric rank-k update with an n x k matrix x.
+//! Only the stored triangle is computed, each element written once, in
+//! blocks of rows so that the rows of x being combined stay in cache.
+template <typename T, triangle U, typename M>
+Enable_if<Matrix_type<M>(), void> syrk(T alpha, const M &x,
+                                       SymmetricMatrix<T, U> &a) {
+  static_assert(M::order() == 2, "syrk: x must be 2-D");
+  const std::size_t n = a.n_rows(), k = x.n_cols();
+  assert(x.n_rows() == n);
+
+  const Matrix<T, 2> xd(x); // dense row-major copy
+  const std::size_t block = 64;
+  for (std::size_t ib = 0; ib < n; ib += block) {
+    const std::size_t ie = std::min(ib + block, n);
+    for (std::size_t jb = 0; jb < n; jb += block) {
+      const std::size_t je = std::min(jb + block, n);
+      if (!a.stored(ib, je - 1) && !a.stored(ie - 1, jb))
+        continue; // block entirely outside the stored triangle
+      for (std::size_t i = ib; i != ie; ++i) {
+        const T *xi = xd.data() + i * k;
+        for (std::size_t j = jb; j != je; ++j) {
+          if (!a.stored(i, j))
+            continue;
+          const T *xj = xd.data() + j * k;
+          T s = T{};
+          for (std::size_t p = 0; p != k; ++p)
+            s += xi[p] * xj[p];
+          a(i, j) += alpha * s;
+        }
+      }
+    }
+  }
+}
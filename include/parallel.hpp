@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "instrument.hpp"
+
+namespace matrix_impl {
+// Upper bound on the number of threads used by the parallel kernels. 0 means
+// "as many as the hardware reports".
+inline std::atomic<std::size_t> &max_threads() {
+  static std::atomic<std::size_t> n{0};
+  return n;
+}
+
+inline std::size_t thread_count() {
+  std::size_t n = max_threads();
+  if (n == 0)
+    n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : n;
+}
+
+// Call f(c) for every c in [0, n), each on its own thread. The calling
+// thread runs c = 0, so n == 1 never spawns a thread.
+template <typename F> void parallel_tasks(std::size_t n, F f) {
+  if (n == 0)
+    return;
+  // the workers charge their allocations to the caller's MATRIX_TAG
+  const char *tag = instrument_impl::current_tag();
+  std::vector<std::thread> workers;
+  workers.reserve(n - 1);
+  for (std::size_t c = 1; c != n; ++c)
+    workers.emplace_back(
+        [&f, tag](std::size_t i) {
+          instrument_impl::tag_scope scope(tag);
+          f(i);
+        },
+        c);
+  f(std::size_t(0));
+  for (auto &w : workers)
+    w.join();
+}
+
+// Split [first, last) into contiguous chunks of at least grain indices, at
+// most one per thread, and call f(begin, end) on each of them.
+template <typename F>
+void parallel_for(std::size_t first, std::size_t last, std::size_t grain,
+                  F f) {
+  if (first >= last)
+    return;
+  const std::size_t n = last - first;
+  const std::size_t chunks = std::max<std::size_t>(
+      1, std::min(thread_count(), n / std::max<std::size_t>(grain, 1)));
+  parallel_tasks(chunks, [&](std::size_t c) {
+    f(first + n * c / chunks, first + n * (c + 1) / chunks);
+  });
+}
+} // namespace matrix_impl
+
+//! limit the threads used by the parallel kernels (0 = hardware concurrency)
+inline void set_num_threads(std::size_t n) { matrix_impl::max_threads() = n; }
+
+//! number of threads the parallel kernels will use
+inline std::size_t num_threads() { return matrix_impl::thread_count(); }
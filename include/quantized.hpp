@@ -0,0 +1,394 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "dispatch.hpp"
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+#if MATRIX_DISPATCH
+#include <immintrin.h>
+#endif
+
+//! how many (scale, zero point) pairs a QuantizedMatrix has
+enum class quantization {
+  per_tensor, //!< one for the whole matrix
+  per_row     //!< one per row, e.g. per output channel of a weight matrix
+};
+
+//! 2-D matrix of int8 values q standing for the reals scale * (q - zero),
+//! with asymmetric affine quantization. Rows are dense, row-major.
+class QuantizedMatrix {
+public:
+  static constexpr size_t order_ = 2;
+  using value_type = std::int8_t;
+
+  QuantizedMatrix()
+      : rows_{0}, cols_{0}, mode_{quantization::per_tensor}, scale_(1, 1.f),
+        zero_(1, 0) {}
+
+  //! quantize the float Matrix or MatrixRef x
+  template <typename M, typename = Enable_if<Matrix_type<M>()>>
+  explicit QuantizedMatrix(const M &x,
+                           quantization mode = quantization::per_tensor);
+
+  //! number of dimensions
+  static constexpr std::size_t order() { return order_; }
+
+  std::size_t n_rows() const { return rows_; }
+  std::size_t n_cols() const { return cols_; }
+  std::size_t size() const { return q_.size(); }
+  quantization mode() const { return mode_; }
+
+  //! quantization parameters of row i
+  ///@{
+  float scale(std::size_t i) const { return scale_[param(i)]; }
+  std::int32_t zero_point(std::size_t i) const { return zero_[param(i)]; }
+  ///@}
+
+  //! "flat" access to the int8 values
+  ///@{
+  std::int8_t *data() { return q_.data(); }
+  const std::int8_t *data() const { return q_.data(); }
+  ///@}
+
+  //! the int8 values of row i
+  MatrixRef<const std::int8_t, 1> row(std::size_t i) const {
+    assert(i < rows_);
+    return {MatrixSlice<1>{i * cols_, {cols_}, {1}}, data()};
+  }
+
+  //! the real value stored at (i, j)
+  float operator()(std::size_t i, std::size_t j) const {
+    assert(i < rows_ && j < cols_);
+    return scale(i) * float(std::int32_t(q_[i * cols_ + j]) - zero_point(i));
+  }
+
+  //! the reals the matrix stands for
+  Matrix<float, 2> dequantize() const {
+    Matrix<float, 2> m(rows_, cols_);
+    float *p = m.data();
+    matrix_impl::parallel_for(0, rows_, 256, [&](std::size_t a, std::size_t b) {
+      for (std::size_t i = a; i != b; ++i) {
+        const float s = scale(i);
+        const std::int32_t z = zero_point(i);
+        const std::int8_t *q = q_.data() + i * cols_;
+        for (std::size_t j = 0; j != cols_; ++j)
+          p[i * cols_ + j] = s * float(std::int32_t(q[j]) - z);
+      }
+    });
+    return m;
+  }
+
+private:
+  std::size_t rows_, cols_;
+  quantization mode_;
+  std::vector<float> scale_;       // one per row, or a single one
+  std::vector<std::int32_t> zero_; // in [-128, 127], same count as scale_
+  std::vector<std::int8_t> q_;
+
+  std::size_t param(std::size_t i) const {
+    return mode_ == quantization::per_row ? i : 0;
+  }
+};
+
+namespace quant_impl {
+// x rounded to the nearest integer in [lo, hi], NaN to nan. Clamped before
+// lround, whose result is unspecified out of the range of long.
+inline long round_clamped(float x, float lo, float hi, long nan) {
+  if (x != x)
+    return nan;
+  return std::lround(std::max(lo, std::min(hi, x)));
+}
+
+// Scale and zero point mapping [lo, hi] onto [-128, 127]. The range is
+// widened to contain 0 so that zero is exact, which keeps zero padding exact.
+inline void choose_params(float lo, float hi, float &scale,
+                          std::int32_t &zero) {
+  lo = std::min(lo, 0.f);
+  hi = std::max(hi, 0.f);
+  scale = (hi - lo) / 255.f;
+  if (!(scale > 0.f))
+    scale = 1.f;
+  zero = std::int32_t(round_clamped(-128.f - lo / scale, -128.f, 127.f, 0));
+}
+
+// NaN quantizes to the zero point, infinities to the ends of the range
+inline std::int8_t quantize_one(float x, float inv_scale, std::int32_t zero) {
+  const float z = float(zero);
+  return std::int8_t(
+      round_clamped(x * inv_scale, -128.f - z, 127.f - z, 0) + zero);
+}
+
+// out[r] = sum_p a[p] b[r][p] for four rows of b; bsum[r] is the sum of
+// row r of b. One variant per instruction set, picked by select_dot4.
+using dot4_fn = void (*)(const std::int8_t *, const std::int8_t *const *,
+                         const std::int32_t *, std::size_t, std::int32_t *);
+
+// out[r] += the products from p on, in locals: out may alias the int8 rows
+inline void dot4_tail(const std::int8_t *a, const std::int8_t *const *b,
+                      std::size_t p, std::size_t k, std::int32_t *out) {
+  for (std::size_t r = 0; r != 4; ++r) {
+    const std::int8_t *br = b[r];
+    std::int32_t s = 0;
+    for (std::size_t t = p; t != k; ++t)
+      s += std::int32_t(a[t]) * br[t];
+    out[r] += s;
+  }
+}
+
+inline void dot4_scalar(const std::int8_t *a, const std::int8_t *const *b,
+                        const std::int32_t *, std::size_t k,
+                        std::int32_t *out) {
+  for (std::size_t r = 0; r != 4; ++r)
+    out[r] = 0;
+  dot4_tail(a, b, 0, k, out);
+}
+
+#if MATRIX_DISPATCH
+// VNNI multiplies unsigned by signed bytes, so a is offset to a + 128 on the
+// fly and 128 bsum[r] is taken back at the end
+MATRIX_TARGET_VNNI inline void dot4_vnni(const std::int8_t *a,
+                                         const std::int8_t *const *b,
+                                         const std::int32_t *bsum,
+                                         std::size_t k, std::int32_t *out) {
+  const __m512i flip = _mm512_set1_epi8(char(0x80));
+  __m512i acc[4] = {_mm512_setzero_si512(), _mm512_setzero_si512(),
+                    _mm512_setzero_si512(), _mm512_setzero_si512()};
+  std::size_t p = 0;
+  for (; p + 64 <= k; p += 64) {
+    const __m512i au = _mm512_xor_si512(_mm512_loadu_si512(a + p), flip);
+    for (std::size_t r = 0; r != 4; ++r)
+      acc[r] = _mm512_dpbusd_epi32(acc[r], au, _mm512_loadu_si512(b[r] + p));
+  }
+  for (std::size_t r = 0; r != 4; ++r) {
+    std::int32_t s = _mm512_reduce_add_epi32(acc[r]);
+    for (std::size_t t = p; t != k; ++t)
+      s += (std::int32_t(a[t]) + 128) * b[r][t];
+    out[r] = s - 128 * bsum[r];
+  }
+}
+
+// Widened to 16 bits and multiplied with pmaddwd rather than pmaddubsw,
+// whose 16-bit pair sums saturate for full-range int8 inputs
+MATRIX_TARGET_AVX2 inline void dot4_avx2(const std::int8_t *a,
+                                         const std::int8_t *const *b,
+                                         const std::int32_t *, std::size_t k,
+                                         std::int32_t *out) {
+  __m256i acc[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(),
+                    _mm256_setzero_si256(), _mm256_setzero_si256()};
+  std::size_t p = 0;
+  for (; p + 16 <= k; p += 16) {
+    const __m256i aw =
+        _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(a + p)));
+    for (std::size_t r = 0; r != 4; ++r) {
+      const __m256i bw =
+          _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(b[r] + p)));
+      acc[r] = _mm256_add_epi32(acc[r], _mm256_madd_epi16(aw, bw));
+    }
+  }
+  for (std::size_t r = 0; r != 4; ++r) {
+    const __m128i h = _mm_add_epi32(_mm256_castsi256_si128(acc[r]),
+                                    _mm256_extracti128_si256(acc[r], 1));
+    const __m128i q = _mm_add_epi32(h, _mm_shuffle_epi32(h, 0x4e));
+    out[r] = _mm_cvtsi128_si32(_mm_add_epi32(q, _mm_shuffle_epi32(q, 0xb1)));
+  }
+  dot4_tail(a, b, p, k, out);
+}
+#endif
+
+inline dot4_fn select_dot4() {
+#if MATRIX_DISPATCH
+  const isa level = matrix_impl::isa_level().load(std::memory_order_relaxed);
+  if (level >= isa::avx512 && matrix_impl::cpu_has_vnni())
+    return dot4_vnni;
+  if (level >= isa::avx2)
+    return dot4_avx2;
+#endif
+  return dot4_scalar;
+}
+
+// Longest stretch of a row one dot4 call takes: the kernels accumulate in
+// int32, and the VNNI one sums products of up to 255 x 128 before it takes
+// its offset back, which stays below 2^31 up to this length. Longer rows go
+// in chunks whose sums add up in int64.
+constexpr std::size_t qgemm_max_k = std::size_t(1) << 16;
+
+// Number of chunks of at most qgemm_max_k a row of k splits into
+inline std::size_t qgemm_chunks(std::size_t k) {
+  return (k + qgemm_max_k - 1) / qgemm_max_k;
+}
+
+// Sum of every row
+inline std::vector<std::int64_t> row_sums(const QuantizedMatrix &m) {
+  std::vector<std::int64_t> s(m.n_rows());
+  const std::size_t k = m.n_cols();
+  for (std::size_t i = 0; i != m.n_rows(); ++i) {
+    const std::int8_t *q = m.data() + i * k;
+    std::int64_t acc = 0;
+    for (std::size_t p = 0; p != k; ++p)
+      acc += q[p];
+    s[i] = acc;
+  }
+  return s;
+}
+
+// Sum of every chunk of every row: chunk c of row i at i * chunks + c
+inline std::vector<std::int32_t> chunk_sums(const QuantizedMatrix &m) {
+  const std::size_t k = m.n_cols(), nc = qgemm_chunks(k);
+  std::vector<std::int32_t> s(m.n_rows() * nc);
+  for (std::size_t i = 0; i != m.n_rows(); ++i)
+    for (std::size_t c = 0; c != nc; ++c) {
+      const std::int8_t *q = m.data() + i * k + c * qgemm_max_k;
+      const std::size_t len = std::min(qgemm_max_k, k - c * qgemm_max_k);
+      std::int32_t acc = 0;
+      for (std::size_t p = 0; p != len; ++p)
+        acc += q[p];
+      s[i * nc + c] = acc;
+    }
+  return s;
+}
+
+// Rows of b walked per block by qgemm: a block of 64 rows of a few KB each
+// stays in L2 while the rows of a stream past it
+constexpr std::size_t qgemm_block = 64;
+
+// c(i, j) = f(i, j, sum_p a(i, p) b(j, p)) over the int8 values, the sum
+// taken in int64
+template <typename T, typename F>
+Matrix<T, 2> qgemm(const QuantizedMatrix &a, const QuantizedMatrix &b, F f) {
+  assert(a.n_cols() == b.n_cols());
+  const std::size_t m = a.n_rows(), n = b.n_rows(), k = a.n_cols();
+  const std::size_t nc = qgemm_chunks(k);
+  const std::vector<std::int32_t> bsum = chunk_sums(b);
+  Matrix<T, 2> c(m, n);
+  T *cp = c.data();
+
+  const dot4_fn dot4 = select_dot4();
+  matrix_impl::parallel_for(0, m, 8, [&](std::size_t i0, std::size_t i1) {
+    const std::int8_t *rows[4];
+    std::int32_t sums[4], out[4];
+    std::int64_t acc[4];
+    for (std::size_t jb = 0; jb < n; jb += qgemm_block) {
+      const std::size_t je = std::min(jb + qgemm_block, n);
+      for (std::size_t i = i0; i != i1; ++i) {
+        const std::int8_t *ai = a.data() + i * k;
+        for (std::size_t j = jb; j < je; j += 4) {
+          // a last group of fewer than 4 rows repeats its last row
+          const std::size_t nr = std::min<std::size_t>(4, je - j);
+          for (std::size_t r = 0; r != 4; ++r)
+            acc[r] = 0;
+          for (std::size_t ch = 0; ch != nc; ++ch) {
+            const std::size_t p = ch * qgemm_max_k;
+            for (std::size_t r = 0; r != 4; ++r) {
+              const std::size_t jr = j + std::min(r, nr - 1);
+              rows[r] = b.data() + jr * k + p;
+              sums[r] = bsum[jr * nc + ch];
+            }
+            dot4(ai + p, rows, sums, std::min(qgemm_max_k, k - p), out);
+            for (std::size_t r = 0; r != 4; ++r)
+              acc[r] += out[r];
+          }
+          for (std::size_t r = 0; r != nr; ++r)
+            cp[i * n + j + r] = f(i, j + r, acc[r]);
+        }
+      }
+    }
+  });
+  return c;
+}
+} // namespace quant_impl
+
+// Each row, or the whole matrix, gets the scale and zero point of its range
+template <typename M, typename>
+QuantizedMatrix::QuantizedMatrix(const M &x, quantization mode)
+    : rows_{x.n_rows()}, cols_{x.n_cols()}, mode_{mode},
+      scale_(mode == quantization::per_row ? x.n_rows() : 1),
+      zero_(scale_.size()), q_(x.n_rows() * x.n_cols()) {
+  static_assert(M::order() == 2, "QuantizedMatrix: order mismatch");
+  const MatrixSlice<2> &d = x.descriptor();
+  const typename M::value_type *p = x.data() + d.start;
+  auto at = [&](std::size_t i, std::size_t j) {
+    return float(p[i * d.strides[0] + j * d.strides[1]]);
+  };
+
+  std::vector<float> lo(rows_, 0.f), hi(rows_, 0.f);
+  matrix_impl::parallel_for(0, rows_, 256, [&](std::size_t a, std::size_t b) {
+    for (std::size_t i = a; i != b; ++i)
+      for (std::size_t j = 0; j != cols_; ++j) {
+        lo[i] = std::min(lo[i], at(i, j));
+        hi[i] = std::max(hi[i], at(i, j));
+      }
+  });
+  if (mode == quantization::per_row) {
+    for (std::size_t i = 0; i != rows_; ++i)
+      quant_impl::choose_params(lo[i], hi[i], scale_[i], zero_[i]);
+  } else {
+    quant_impl::choose_params(
+        rows_ ? *std::min_element(lo.begin(), lo.end()) : 0.f,
+        rows_ ? *std::max_element(hi.begin(), hi.end()) : 0.f, scale_[0],
+        zero_[0]);
+  }
+
+  matrix_impl::parallel_for(0, rows_, 256, [&](std::size_t a, std::size_t b) {
+    for (std::size_t i = a; i != b; ++i) {
+      const float inv = 1.f / scale(i);
+      const std::int32_t z = zero_point(i);
+      for (std::size_t j = 0; j != cols_; ++j)
+        q_[i * cols_ + j] = quant_impl::quantize_one(at(i, j), inv, z);
+    }
+  });
+}
+
+//! quantize a float matrix to int8
+template <typename M>
+Enable_if<Matrix_type<M>(), QuantizedMatrix>
+quantize(const M &x, quantization mode = quantization::per_tensor) {
+  MATRIX_TIMED("quantize");
+  return QuantizedMatrix(x, mode);
+}
+
+//! the float matrix q stands for
+inline Matrix<float, 2> dequantize(const QuantizedMatrix &q) {
+  return q.dequantize();
+}
+
+//! The raw int8 product a b^T accumulated in int32: c(i, j) is the dot
+//! product of row i of a and row j of b, both k long. Taking the right
+//! operand by rows is the usual layout of weight matrices and keeps both
+//! sides of every dot product unit stride, as the VNNI and pmaddwd
+//! instructions want them. Throws std::length_error when k is over 65536,
+//! past which the sums may not fit in int32.
+inline Matrix<std::int32_t, 2> qgemm_s32(const QuantizedMatrix &a,
+                                         const QuantizedMatrix &b) {
+  MATRIX_TIMED("qgemm_s32");
+  if (a.n_cols() > quant_impl::qgemm_max_k)
+    throw std::length_error("qgemm_s32: rows too long for int32 sums");
+  return quant_impl::qgemm<std::int32_t>(
+      a, b, [](std::size_t, std::size_t, std::int64_t s) {
+        return std::int32_t(s);
+      });
+}
+
+//! The real product a b^T: qgemm_s32 with the zero points and scales of
+//! both sides (per tensor or per row) applied to every element. Rows of
+//! any length: the sums are taken in int64.
+inline Matrix<float, 2> qgemm(const QuantizedMatrix &a,
+                              const QuantizedMatrix &b) {
+  MATRIX_TIMED("qgemm");
+  const std::vector<std::int64_t> asum = quant_impl::row_sums(a);
+  const std::vector<std::int64_t> bsum = quant_impl::row_sums(b);
+  const std::int64_t k = std::int64_t(a.n_cols());
+  return quant_impl::qgemm<float>(
+      a, b, [&](std::size_t i, std::size_t j, std::int64_t s) {
+        const std::int64_t za = a.zero_point(i), zb = b.zero_point(j);
+        return a.scale(i) * b.scale(j) *
+               float(s - za * bsum[j] - zb * asum[i] + k * za * zb);
+      });
+}
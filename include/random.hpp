@@ -0,0 +1,252 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "dispatch.hpp"
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+// Parallel random fills built on the Philox4x32-10 counter-based generator
+// (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC'11).
+// Element e, in the logical (row-major) order of the filled view, takes its
+// value from the counter e / k, k being the number of values one counter
+// yields. Its value thus depends only on the seed, the stream and e: not on
+// the number of threads, on how the range is split, or on the strides.
+
+//! distributions for fill_random
+///@{
+
+//! uniform reals in [lo, hi)
+struct uniform_dist {
+  double lo, hi;
+  uniform_dist(double a = 0, double b = 1) : lo{a}, hi{b} {}
+};
+
+//! normal (Gaussian) reals, by the Box-Muller transform
+struct normal_dist {
+  double mean, stddev;
+  normal_dist(double m = 0, double s = 1) : mean{m}, stddev{s} {}
+};
+
+//! uniform integers in [lo, hi], both included
+struct integer_dist {
+  long long lo, hi;
+  integer_dist(long long a, long long b) : lo{a}, hi{b} {}
+};
+///@}
+
+namespace random_impl {
+constexpr std::uint32_t philox_m0 = 0xD2511F53, philox_m1 = 0xCD9E8D57;
+constexpr std::uint32_t philox_w0 = 0x9E3779B9, philox_w1 = 0xBB67AE85;
+
+// Counters per block of philox_kernel: 16 lanes of 4 words, so the rounds
+// are straight loops over lanes that vectorize
+constexpr std::size_t philox_lanes = 16;
+
+// out[4 i + w] = word w of Philox4x32-10 at counter (first + i, stream),
+// key (k0, k1), for i in [0, n)
+struct philox_kernel {
+  static MATRIX_KERNEL void run(std::uint32_t k0, std::uint32_t k1,
+                                std::uint64_t first, std::uint64_t stream,
+                                std::size_t n, std::uint32_t *out) {
+    for (std::size_t b = 0; b < n; b += philox_lanes) {
+      std::uint32_t x0[philox_lanes], x1[philox_lanes];
+      std::uint32_t x2[philox_lanes], x3[philox_lanes];
+      for (std::size_t i = 0; i != philox_lanes; ++i) {
+        const std::uint64_t c = first + b + i;
+        x0[i] = std::uint32_t(c);
+        x1[i] = std::uint32_t(c >> 32);
+        x2[i] = std::uint32_t(stream);
+        x3[i] = std::uint32_t(stream >> 32);
+      }
+      std::uint32_t ka = k0, kb = k1;
+      for (int r = 0; r != 10; ++r) {
+        for (std::size_t i = 0; i != philox_lanes; ++i) {
+          const std::uint64_t p0 = std::uint64_t(philox_m0) * x0[i];
+          const std::uint64_t p1 = std::uint64_t(philox_m1) * x2[i];
+          const std::uint32_t y0 = std::uint32_t(p1 >> 32) ^ x1[i] ^ ka;
+          const std::uint32_t y2 = std::uint32_t(p0 >> 32) ^ x3[i] ^ kb;
+          x1[i] = std::uint32_t(p1);
+          x3[i] = std::uint32_t(p0);
+          x0[i] = y0;
+          x2[i] = y2;
+        }
+        ka += philox_w0;
+        kb += philox_w1;
+      }
+      const std::size_t m = std::min(philox_lanes, n - b);
+      for (std::size_t i = 0; i != m; ++i) {
+        out[4 * (b + i)] = x0[i];
+        out[4 * (b + i) + 1] = x1[i];
+        out[4 * (b + i) + 2] = x2[i];
+        out[4 * (b + i) + 3] = x3[i];
+      }
+    }
+  }
+};
+
+// 32 random bits per value for types up to 4 bytes, 64 above
+template <typename T> constexpr std::size_t words() {
+  return sizeof(T) > 4 ? 2 : 1;
+}
+
+inline std::uint64_t bits64(const std::uint32_t *w) {
+  return std::uint64_t(w[0]) | std::uint64_t(w[1]) << 32;
+}
+
+// Uniform in [0, 1) and (0, 1] with all the bits the type can hold: 53
+// for double, 24 for float
+constexpr double two_m53 = 1.0 / 9007199254740992.0;
+constexpr float two_m24 = 1.0f / 16777216.0f;
+
+template <typename T> T unit_open(const std::uint32_t *w) {
+  return words<T>() == 2 ? T((bits64(w) >> 11) * two_m53)
+                         : T((w[0] >> 8) * two_m24);
+}
+
+template <typename T> T unit_closed(const std::uint32_t *w) {
+  return words<T>() == 2 ? T(((bits64(w) >> 11) + 1) * two_m53)
+                         : T(((w[0] >> 8) + 1) * two_m24);
+}
+
+// High 64 bits of x r: x scaled onto [0, r)
+inline std::uint64_t mul_high(std::uint64_t x, std::uint64_t r) {
+#ifdef __SIZEOF_INT128__
+  return std::uint64_t((unsigned __int128)x * r >> 64);
+#else
+  const std::uint64_t xl = x & 0xffffffff, xh = x >> 32;
+  const std::uint64_t rl = r & 0xffffffff, rh = r >> 32;
+  const std::uint64_t mid = xh * rl + (xl * rl >> 32);
+  return xh * rh + (mid >> 32) + ((mid & 0xffffffff) + xl * rh >> 32);
+#endif
+}
+
+// Turn the 4 words of one counter into 4 / words<T>() values
+template <typename T>
+void transform(const uniform_dist &d, const std::uint32_t *w, T *v) {
+  constexpr std::size_t k = 4 / words<T>();
+  for (std::size_t i = 0; i != k; ++i)
+    v[i] = T(d.lo + (d.hi - d.lo) * unit_open<T>(w + i * words<T>()));
+}
+
+template <typename T>
+void transform(const normal_dist &d, const std::uint32_t *w, T *v) {
+  constexpr std::size_t k = 4 / words<T>();
+  for (std::size_t i = 0; i != k; i += 2) {
+    const T u1 = unit_closed<T>(w + i * words<T>());
+    const T u2 = unit_open<T>(w + (i + 1) * words<T>());
+    const T r = std::sqrt(T(-2) * std::log(u1));
+    const T t = T(6.283185307179586476925) * u2;
+    v[i] = T(d.mean + d.stddev * r * std::cos(t));
+    v[i + 1] = T(d.mean + d.stddev * r * std::sin(t));
+  }
+}
+
+// Multiply-shift onto the range; the bias is below range / 2^bits
+template <typename T>
+void transform(const integer_dist &d, const std::uint32_t *w, T *v) {
+  constexpr std::size_t k = 4 / words<T>();
+  const std::uint64_t range = std::uint64_t(d.hi) - std::uint64_t(d.lo) + 1;
+  for (std::size_t i = 0; i != k; ++i) {
+    const std::uint64_t x = words<T>() == 2
+                                ? bits64(w + 2 * i)
+                                : std::uint64_t(w[i]) << 32;
+    const std::uint64_t off = range == 0 ? x : mul_high(x, range);
+    v[i] = T(std::uint64_t(d.lo) + off);
+  }
+}
+
+template <typename T>
+void check(const uniform_dist &) {
+  static_assert(std::is_floating_point<T>::value,
+                "fill_random: uniform_dist needs a floating point matrix");
+}
+
+template <typename T> void check(const normal_dist &) {
+  static_assert(std::is_floating_point<T>::value,
+                "fill_random: normal_dist needs a floating point matrix");
+}
+
+template <typename T> void check(const integer_dist &d) {
+  static_assert(std::is_integral<T>::value,
+                "fill_random: integer_dist needs an integer matrix");
+  assert(d.lo <= d.hi);
+  ignore(d);
+}
+
+// Counters per task chunk, and elements per task
+constexpr std::size_t block = 64;
+constexpr std::size_t grain = 16384;
+
+// Fill the elements [first, last) of (d, p), in logical order, from the
+// counters of the seed and stream
+template <typename T, std::size_t N, typename D>
+void fill_range(const MatrixSlice<N> &d, T *p, const D &dist,
+                std::uint64_t seed, std::uint64_t stream, std::size_t first,
+                std::size_t last) {
+  constexpr std::size_t k = 4 / words<T>();
+  const std::size_t len = d.extents[N - 1], s = d.strides[N - 1];
+  std::uint32_t w[4 * block];
+  T v[k * block];
+
+  std::size_t e = first;
+  while (e != last) {
+    const std::size_t c = e / k;
+    const std::size_t nc = std::min(block, (last - 1) / k + 1 - c);
+    matrix_impl::dispatch<philox_kernel>(std::uint32_t(seed),
+                                         std::uint32_t(seed >> 32),
+                                         std::uint64_t(c), stream, nc, w);
+    for (std::size_t i = 0; i != nc; ++i)
+      transform(dist, w + 4 * i, v + k * i);
+
+    // copy v[e - c k ..] to the logical positions from e on, line by line
+    const std::size_t stop = std::min(last, (c + nc) * k);
+    while (e != stop) {
+      const std::size_t j = e % len, n = std::min(len - j, stop - e);
+      T *q = p + matrix_impl::line_offset(d, e / len) + j * s;
+      const T *src = v + (e - c * k);
+      for (std::size_t t = 0; t != n; ++t)
+        q[t * s] = src[t];
+      e += n;
+    }
+  }
+}
+} // namespace random_impl
+
+//! Philox4x32-10 of the 128-bit counter ctr with the 64-bit key key
+inline std::array<std::uint32_t, 4>
+philox4x32(const std::array<std::uint32_t, 4> &ctr,
+           const std::array<std::uint32_t, 2> &key) {
+  std::array<std::uint32_t, 4> out;
+  random_impl::philox_kernel::run(
+      key[0], key[1], std::uint64_t(ctr[0]) | std::uint64_t(ctr[1]) << 32,
+      std::uint64_t(ctr[2]) | std::uint64_t(ctr[3]) << 32, 1, out.data());
+  return out;
+}
+
+//! Fill m, a Matrix or MatrixRef of any strides, with values of dist. The
+//! values depend only on seed, stream and the logical position of each
+//! element, so any thread count gives the same matrix; different streams
+//! give independent sequences for the same seed. Threads split the
+//! elements by logical range.
+template <typename M, typename D>
+Enable_if<Matrix_type<typename std::remove_reference<M>::type>(), void>
+fill_random(M &&m, const D &dist, std::uint64_t seed,
+            std::uint64_t stream = 0) {
+  MATRIX_TIMED("fill_random");
+  using T = typename std::remove_reference<M>::type::value_type;
+  random_impl::check<T>(dist);
+  const auto &d = m.descriptor();
+  T *p = m.data();
+  matrix_impl::parallel_for(0, d.size, random_impl::grain,
+                            [&](std::size_t first, std::size_t last) {
+                              random_impl::fill_range(d, p, dist, seed, stream,
+                                                      first, last);
+                            });
+}
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include "half.hpp"
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+// Rolling-window statistics along one axis of a 2-D matrix, e.g. time x
+// series: every window of w consecutive steps of every series, in O(1) per
+// step. Mean and variance slide a Welford update over the window and
+// recompute it exactly every w steps, so rounding errors do not build up
+// along long series. Min and max keep a monotonic deque of the window.
+// Series are independent and split between the threads. RollingWindow does
+// the same for rows that arrive one at a time.
+
+namespace rolling_impl {
+template <typename M>
+using Value = typename std::remove_const<typename M::value_type>::type;
+
+// The type the statistics of V are computed in: double for integers
+template <typename V>
+using Result = typename std::conditional<std::is_integral<V>::value, double,
+                                         Accumulator<V>>::type;
+
+// What a window keeps up to date
+enum : unsigned { moments = 1, minimum = 2, maximum = 4 };
+
+// The last w values of S series, pushed one step (S values) at a time
+template <typename A> class window {
+public:
+  window(std::size_t series, std::size_t w, unsigned what)
+      : s_(series), w_(w), what_(what), t_(0), hist_(w * series) {
+    assert(w >= 1);
+    if (what & moments) {
+      mean_.assign(series, A(0));
+      m2_.assign(series, A(0));
+    }
+    if (what & minimum)
+      lo_.init(series, w);
+    if (what & maximum)
+      hi_.init(series, w);
+  }
+
+  std::size_t series() const { return s_; }
+  std::size_t width() const { return w_; }
+
+  //! values pushed so far, up to the width
+  std::size_t count() const { return std::min(t_, w_); }
+
+  // x[0..S) are the values of the next step
+  void push(const A *x) {
+    const std::size_t slot = t_ % w_;
+    A *h = hist_.data() + slot * s_;
+    if (what_ & moments) {
+      if (t_ < w_) { // the window is still growing
+        const A n = A(t_ + 1);
+        for (std::size_t s = 0; s != s_; ++s) {
+          const A d = x[s] - mean_[s];
+          mean_[s] += d / n;
+          m2_[s] += d * (x[s] - mean_[s]);
+        }
+      } else { // x replaces the oldest value h
+        const A n = A(w_);
+        for (std::size_t s = 0; s != s_; ++s) {
+          const A mean = mean_[s] + (x[s] - h[s]) / n;
+          m2_[s] += (x[s] - h[s]) * (x[s] - mean + h[s] - mean_[s]);
+          mean_[s] = mean;
+        }
+      }
+    }
+    if (what_ & minimum)
+      lo_.push(x, t_, w_, [](A a, A b) { return a >= b; });
+    if (what_ & maximum)
+      hi_.push(x, t_, w_, [](A a, A b) { return a <= b; });
+    std::copy(x, x + s_, h);
+    ++t_;
+    if ((what_ & moments) && t_ % w_ == 0)
+      refresh();
+  }
+
+  void mean(A *out) const { std::copy(mean_.begin(), mean_.end(), out); }
+
+  void variance(std::size_t ddof, A *out) const {
+    const A n = A(count()) - A(ddof);
+    for (std::size_t s = 0; s != s_; ++s)
+      out[s] = n > 0 ? std::max(m2_[s], A(0)) / n : A(NAN);
+  }
+
+  void min(A *out) const { lo_.front(out, s_, w_); }
+  void max(A *out) const { hi_.front(out, s_, w_); }
+
+private:
+  // Indices and values of a window in a ring of w slots per series: each
+  // value is kept only while no later value is smaller (larger for max)
+  struct deque {
+    std::vector<std::size_t> t;
+    std::vector<A> v;
+    std::vector<std::size_t> head, size;
+
+    void init(std::size_t series, std::size_t w) {
+      t.resize(series * w);
+      v.resize(series * w);
+      head.assign(series, 0);
+      size.assign(series, 0);
+    }
+
+    template <typename Drop>
+    void push(const A *x, std::size_t now, std::size_t w, Drop drop) {
+      for (std::size_t s = 0; s != head.size(); ++s) {
+        std::size_t *ts = t.data() + s * w;
+        A *vs = v.data() + s * w;
+        std::size_t &h = head[s], &n = size[s];
+        if (n != 0 && ts[h] + w <= now) { // the front left the window
+          h = h + 1 == w ? 0 : h + 1;
+          --n;
+        }
+        while (n != 0 && drop(vs[(h + n - 1) % w], x[s]))
+          --n;
+        const std::size_t back = (h + n) % w;
+        ts[back] = now;
+        vs[back] = x[s];
+        ++n;
+      }
+    }
+
+    void front(A *out, std::size_t series, std::size_t w) const {
+      for (std::size_t s = 0; s != series; ++s)
+        out[s] = v[s * w + head[s]];
+    }
+  };
+
+  // Two-pass mean and m2 of the full window, which t_ has just refilled
+  void refresh() {
+    const A n = A(w_);
+    std::fill(mean_.begin(), mean_.end(), A(0));
+    std::fill(m2_.begin(), m2_.end(), A(0));
+    for (std::size_t k = 0; k != w_; ++k)
+      for (std::size_t s = 0; s != s_; ++s)
+        mean_[s] += hist_[k * s_ + s];
+    for (std::size_t s = 0; s != s_; ++s)
+      mean_[s] /= n;
+    for (std::size_t k = 0; k != w_; ++k)
+      for (std::size_t s = 0; s != s_; ++s) {
+        const A d = hist_[k * s_ + s] - mean_[s];
+        m2_[s] += d * d;
+      }
+  }
+
+  std::size_t s_, w_;
+  unsigned what_;
+  std::size_t t_;          // steps pushed
+  std::vector<A> hist_;    // the last w steps, step t in slot t % w
+  std::vector<A> mean_;    // mean of the window, per series
+  std::vector<A> m2_;      // sum of squared deviations from it
+  deque lo_, hi_;
+};
+
+enum class stat { mean, variance, min, max };
+
+// Series per window, and elements per parallel task
+constexpr std::size_t block = 64;
+constexpr std::size_t grain = 32768;
+
+// stat over every window of w steps along axis of m
+template <typename A, typename M>
+Matrix<A, 2> roll(const M &m, std::size_t w, std::size_t axis, stat what,
+                  std::size_t ddof) {
+  static_assert(M::order() == 2, "rolling: only 2-D matrices");
+  assert(axis < 2);
+  const MatrixSlice<2> &d = m.descriptor();
+  const std::size_t steps = d.extents[axis], series = d.extents[1 - axis];
+  assert(w >= 1 && w <= steps);
+
+  std::array<std::size_t, 2> ext = d.extents;
+  ext[axis] = steps - w + 1;
+  Matrix<A, 2> out(ext);
+  const MatrixSlice<2> &od = out.descriptor();
+
+  const std::size_t ts = d.strides[axis], ss = d.strides[1 - axis];
+  const std::size_t ots = od.strides[axis], oss = od.strides[1 - axis];
+  const Value<M> *p = m.data() + d.start;
+  A *o = out.data();
+  const unsigned keep = what == stat::min   ? minimum
+                        : what == stat::max ? maximum
+                                            : moments;
+
+  matrix_impl::parallel_for(
+      0, series, std::max<std::size_t>(1, grain / steps),
+      [&](std::size_t first, std::size_t last) {
+        A x[block], r[block];
+        for (std::size_t s0 = first; s0 < last; s0 += block) {
+          const std::size_t b = std::min(block, last - s0);
+          window<A> win(b, w, keep);
+          for (std::size_t t = 0; t != steps; ++t) {
+            for (std::size_t k = 0; k != b; ++k)
+              x[k] = A(p[t * ts + (s0 + k) * ss]);
+            win.push(x);
+            if (t + 1 < w)
+              continue;
+            switch (what) {
+            case stat::mean:
+              win.mean(r);
+              break;
+            case stat::variance:
+              win.variance(ddof, r);
+              break;
+            case stat::min:
+              win.min(r);
+              break;
+            case stat::max:
+              win.max(r);
+              break;
+            }
+            A *q = o + (t + 1 - w) * ots + s0 * oss;
+            for (std::size_t k = 0; k != b; ++k)
+              q[k * oss] = r[k];
+          }
+        }
+      });
+  return out;
+}
+} // namespace rolling_impl
+
+//! Statistics of every window of w consecutive elements along axis of the
+//! 2-D matrix m. The result has m's extents, except along axis, where it
+//! has one element per full window (extent - w + 1). It is computed in the
+//! accumulator type of the elements, or in double for integers.
+///@{
+template <typename M>
+Enable_if<Matrix_type<M>(),
+          Matrix<rolling_impl::Result<rolling_impl::Value<M>>, 2>>
+rolling_mean(const M &m, std::size_t w, std::size_t axis = 0) {
+  using A = rolling_impl::Result<rolling_impl::Value<M>>;
+  return rolling_impl::roll<A>(m, w, axis, rolling_impl::stat::mean, 0);
+}
+
+//! variance with divisor w - ddof (1 by default: the sample variance)
+template <typename M>
+Enable_if<Matrix_type<M>(),
+          Matrix<rolling_impl::Result<rolling_impl::Value<M>>, 2>>
+rolling_var(const M &m, std::size_t w, std::size_t axis = 0,
+            std::size_t ddof = 1) {
+  using A = rolling_impl::Result<rolling_impl::Value<M>>;
+  return rolling_impl::roll<A>(m, w, axis, rolling_impl::stat::variance,
+                               ddof);
+}
+
+template <typename M>
+Enable_if<Matrix_type<M>(),
+          Matrix<rolling_impl::Result<rolling_impl::Value<M>>, 2>>
+rolling_min(const M &m, std::size_t w, std::size_t axis = 0) {
+  using A = rolling_impl::Result<rolling_impl::Value<M>>;
+  return rolling_impl::roll<A>(m, w, axis, rolling_impl::stat::min, 0);
+}
+
+template <typename M>
+Enable_if<Matrix_type<M>(),
+          Matrix<rolling_impl::Result<rolling_impl::Value<M>>, 2>>
+rolling_max(const M &m, std::size_t w, std::size_t axis = 0) {
+  using A = rolling_impl::Result<rolling_impl::Value<M>>;
+  return rolling_impl::roll<A>(m, w, axis, rolling_impl::stat::max, 0);
+}
+///@}
+
+//! Streaming rolling statistics: the last w rows pushed, of a fixed number
+//! of series. Each push is O(1) per series. Until w rows have been pushed
+//! the statistics cover the rows there are.
+template <typename T = double> class RollingWindow {
+public:
+  using value_type = rolling_impl::Result<T>;
+
+  RollingWindow(std::size_t series, std::size_t w)
+      : win_(series, w,
+             rolling_impl::moments | rolling_impl::minimum |
+                 rolling_impl::maximum),
+        row_(series) {}
+
+  std::size_t series() const { return win_.series(); }
+  std::size_t width() const { return win_.width(); }
+
+  //! rows in the window (w once it is full)
+  std::size_t count() const { return win_.count(); }
+  bool full() const { return count() == width(); }
+
+  //! append a row of series() values, dropping the oldest one when full
+  template <typename V> Enable_if<Matrix_type<V>(), void> push(const V &row) {
+    static_assert(V::order() == 1, "RollingWindow: push a 1-D row");
+    assert(row.extent(0) == series());
+    const MatrixSlice<1> &d = row.descriptor();
+    for (std::size_t s = 0; s != series(); ++s)
+      row_[s] = value_type(row.data()[d.start + s * d.strides[0]]);
+    win_.push(row_.data());
+  }
+
+  //! statistics of the window, one per series
+  ///@{
+  Matrix<value_type, 1> mean() const { return get(&window::mean); }
+  Matrix<value_type, 1> var(std::size_t ddof = 1) const {
+    Matrix<value_type, 1> out(series());
+    win_.variance(ddof, out.data());
+    return out;
+  }
+  Matrix<value_type, 1> min() const { return get(&window::min); }
+  Matrix<value_type, 1> max() const { return get(&window::max); }
+  ///@}
+
+private:
+  using window = rolling_impl::window<value_type>;
+
+  Matrix<value_type, 1> get(void (window::*f)(value_type *) const) const {
+    assert(count() != 0);
+    Matrix<value_type, 1> out(series());
+    (win_.*f)(out.data());
+    return out;
+  }
+
+  window win_;
+  std::vector<value_type> row_;
+};
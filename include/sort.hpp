@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+// Sorting and ranking along one axis of a Matrix or view of any order and
+// strides: sort() in place, argsort(), and topk() for the k largest elements
+// of every line with their indices. Lines are independent and split between
+// the threads. NaNs compare greater than every number, so sort() puts them
+// last and topk() first, as the ordering requires.
+//
+// topk() never sorts a whole line: it keeps up to a few times k candidates
+// and a threshold, the k-th largest candidate so far. Most of a long line is
+// scanned in blocks with one branch-free comparison per element against the
+// threshold; only blocks holding larger elements are revisited, and when the
+// candidates fill up they are cut back to k, which raises the threshold.
+
+namespace sort_impl {
+template <typename M>
+using Value = typename std::remove_const<typename M::value_type>::type;
+
+template <typename M> using Bare = typename std::remove_reference<M>::type;
+
+// Elements per parallel task, elements per topk block, and candidates a
+// topk line keeps before cutting them back to k, at least
+constexpr std::size_t grain = 32768;
+constexpr std::size_t block = 256;
+constexpr std::size_t min_candidates = 256;
+
+// a < b, with NaN greater than everything else
+template <typename T> bool less(const T &a, const T &b) {
+  return a < b || (b != b && a == a);
+}
+
+// (value, index) pairs in ascending order of value, then of index
+struct ascending {
+  template <typename T, typename I>
+  bool operator()(const std::pair<T, I> &a, const std::pair<T, I> &b) const {
+    return less(a.first, b.first) ||
+           (!less(b.first, a.first) && a.second < b.second);
+  }
+};
+
+// (value, index) pairs in descending order of value, then ascending index
+struct descending {
+  template <typename T, typename I>
+  bool operator()(const std::pair<T, I> &a, const std::pair<T, I> &b) const {
+    return less(b.first, a.first) ||
+           (!less(a.first, b.first) && a.second < b.second);
+  }
+};
+
+// Call f(in, out, n, scratch) for every line along the last dimension of d
+// and od, split between the threads: in and out are the offsets of its
+// first elements in d and od, n its length along d and scratch a vector
+// private to the thread
+template <typename S, std::size_t N, typename F>
+void for_lines(const MatrixSlice<N> &d, const MatrixSlice<N> &od, F f) {
+  const std::size_t n = d.extents[N - 1];
+  if (n == 0)
+    return;
+  matrix_impl::parallel_for(
+      0, matrix_impl::line_count(d), std::max<std::size_t>(1, grain / n),
+      [&](std::size_t first, std::size_t last) {
+        std::vector<S> scratch;
+        for (std::size_t l = first; l != last; ++l)
+          f(matrix_impl::line_offset(d, l), matrix_impl::line_offset(od, l), n,
+            scratch);
+      });
+}
+
+// The first n candidates cut back to the k first in descending order;
+// returns the last of them, the threshold
+template <typename T>
+T cut(std::pair<T, std::size_t> *c, std::size_t n, std::size_t k) {
+  std::nth_element(c, c + (k - 1), c + n, descending());
+  return c[k - 1].first;
+}
+
+// The k largest of the n elements p[j st] into c, in descending order
+template <bool Unit, typename T>
+void top_line(const T *p, std::size_t st, std::size_t n, std::size_t k,
+              std::vector<std::pair<T, std::size_t>> &c) {
+  const std::size_t s = Unit ? 1 : st;
+  const std::size_t cap = std::max(2 * k, min_candidates);
+  c.resize(cap + block);
+  std::size_t m = k; // candidates
+  for (std::size_t j = 0; j != k; ++j)
+    c[j] = std::make_pair(p[j * s], j);
+  T thr = cut(c.data(), m, k);
+  for (std::size_t j0 = k; j0 < n; j0 += block) {
+    const std::size_t j1 = std::min(j0 + block, n);
+    unsigned hits = 0;
+    for (std::size_t j = j0; j != j1; ++j) // !(x <= thr) also takes NaN
+      hits += !(p[j * s] <= thr);
+    if (hits == 0)
+      continue;
+    for (std::size_t j = j0; j != j1; ++j) { // append without branching
+      c[m] = std::make_pair(p[j * s], j);
+      m += !(p[j * s] <= thr);
+    }
+    if (m >= cap) {
+      thr = cut(c.data(), m, k);
+      m = k;
+    }
+  }
+  cut(c.data(), m, k);
+  std::sort(c.begin(), c.begin() + k, descending());
+}
+} // namespace sort_impl
+
+//! Sort every line along axis (the last one by default) of m in place, in
+//! ascending order
+template <typename M>
+Enable_if<Matrix_type<sort_impl::Bare<M>>(), void>
+sort(M &&m, std::size_t axis = sort_impl::Bare<M>::order() - 1) {
+  using T = sort_impl::Value<sort_impl::Bare<M>>;
+  constexpr std::size_t N = sort_impl::Bare<M>::order();
+  const MatrixSlice<N> d = matrix_impl::axis_last(m.descriptor(), axis);
+  const std::size_t st = d.strides[N - 1];
+  T *p = m.data();
+  sort_impl::for_lines<T>(d, d, [&](std::size_t in, std::size_t,
+                                    std::size_t n, std::vector<T> &buf) {
+    T *x = p + in;
+    if (st == 1) {
+      std::sort(x, x + n, sort_impl::less<T>);
+      return;
+    }
+    buf.resize(n);
+    for (std::size_t j = 0; j != n; ++j)
+      buf[j] = x[j * st];
+    std::sort(buf.begin(), buf.end(), sort_impl::less<T>);
+    for (std::size_t j = 0; j != n; ++j)
+      x[j * st] = buf[j];
+  });
+}
+
+//! The indices that sort every line along axis of m: line l of the result
+//! lists the indices of line l of m in ascending order of their elements,
+//! equal elements in ascending order of index
+template <typename M>
+Enable_if<Matrix_type<M>(), Matrix<std::size_t, M::order()>>
+argsort(const M &m, std::size_t axis = M::order() - 1) {
+  using T = sort_impl::Value<M>;
+  using P = std::pair<T, std::size_t>;
+  constexpr std::size_t N = M::order();
+  Matrix<std::size_t, N> out(m.descriptor().extents);
+  const MatrixSlice<N> d = matrix_impl::axis_last(m.descriptor(), axis);
+  const MatrixSlice<N> od = matrix_impl::axis_last(out.descriptor(), axis);
+  const std::size_t st = d.strides[N - 1], ost = od.strides[N - 1];
+  const T *p = m.data();
+  std::size_t *q = out.data();
+  sort_impl::for_lines<P>(d, od, [&](std::size_t in, std::size_t to,
+                                     std::size_t n, std::vector<P> &buf) {
+    buf.resize(n);
+    for (std::size_t j = 0; j != n; ++j)
+      buf[j] = P(p[in + j * st], j);
+    std::sort(buf.begin(), buf.end(), sort_impl::ascending());
+    for (std::size_t j = 0; j != n; ++j)
+      q[to + j * ost] = buf[j].second;
+  });
+  return out;
+}
+
+//! The k largest elements of every line along axis, and their indices
+template <typename T, std::size_t N> struct topk_result {
+  Matrix<T, N> values;             //!< in descending order along axis
+  Matrix<std::size_t, N> indices; //!< of the values in their lines
+};
+
+//! The k largest elements of every line along axis (the last one by
+//! default) of m, largest first; among equal elements the lowest indices
+//! win. The result has m's extents, except k along axis.
+template <typename M>
+Enable_if<Matrix_type<M>(), topk_result<sort_impl::Value<M>, M::order()>>
+topk(const M &m, std::size_t k, std::size_t axis = M::order() - 1) {
+  using T = sort_impl::Value<M>;
+  using P = std::pair<T, std::size_t>;
+  constexpr std::size_t N = M::order();
+  const MatrixSlice<N> d = matrix_impl::axis_last(m.descriptor(), axis);
+  assert(k <= d.extents[N - 1]);
+  std::array<std::size_t, N> ext = m.descriptor().extents;
+  ext[axis] = k;
+  topk_result<T, N> r{Matrix<T, N>(ext), Matrix<std::size_t, N>(ext)};
+  if (k == 0)
+    return r;
+  const MatrixSlice<N> od = matrix_impl::axis_last(r.values.descriptor(), axis);
+  const std::size_t st = d.strides[N - 1], ost = od.strides[N - 1];
+  const T *p = m.data();
+  T *v = r.values.data();
+  std::size_t *ix = r.indices.data();
+  sort_impl::for_lines<P>(d, od, [&](std::size_t in, std::size_t to,
+                                     std::size_t n, std::vector<P> &c) {
+    if (st == 1)
+      sort_impl::top_line<true>(p + in, st, n, k, c);
+    else
+      sort_impl::top_line<false>(p + in, st, n, k, c);
+    for (std::size_t j = 0; j != k; ++j) {
+      v[to + j * ost] = c[j].first;
+      ix[to + j * ost] = c[j].second;
+    }
+  });
+  return r;
+}
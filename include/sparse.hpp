@@ -0,0 +1,299 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <numeric>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+//! Coordinate (triplet) builder for sparse matrices. Entries may come in any
+//! order and the same (i, j) may appear several times; the duplicates are
+//! summed when the triplets are compressed into a CsrMatrix.
+template <typename T> class CooMatrix {
+public:
+  using value_type = T;
+
+  CooMatrix() : rows_{0}, cols_{0} {}
+  CooMatrix(std::size_t rows, std::size_t cols) : rows_{rows}, cols_{cols} {}
+
+  std::size_t n_rows() const { return rows_; }
+  std::size_t n_cols() const { return cols_; }
+
+  //! number of triplets
+  std::size_t size() const { return vals_.size(); }
+
+  void reserve(std::size_t n) {
+    row_.reserve(n);
+    col_.reserve(n);
+    vals_.reserve(n);
+  }
+
+  //! add v at (i, j)
+  void add(std::size_t i, std::size_t j, const T &v) {
+    assert(i < rows_ && j < cols_);
+    row_.push_back(i);
+    col_.push_back(j);
+    vals_.push_back(v);
+  }
+
+  //! the triplets, as parallel arrays
+  ///@{
+  const std::vector<std::size_t> &row_indices() const { return row_; }
+  const std::vector<std::size_t> &col_indices() const { return col_; }
+  const std::vector<T> &values() const { return vals_; }
+  ///@}
+
+private:
+  std::size_t rows_, cols_;
+  std::vector<std::size_t> row_, col_;
+  std::vector<T> vals_;
+};
+
+//! Compressed sparse row matrix: the non-zeros of row i are
+//! values()[row_ptr()[i] .. row_ptr()[i + 1]), sorted by column.
+template <typename T> class CsrMatrix {
+public:
+  static constexpr size_t order_ = 2;
+  using value_type = T;
+
+  CsrMatrix() : rows_{0}, cols_{0}, ptr_(1, 0) {}
+
+  //! compress the triplets of a CooMatrix, summing duplicates
+  explicit CsrMatrix(const CooMatrix<T> &coo);
+
+  //! keep the non-zeros of a dense Matrix or MatrixRef
+  template <typename M, typename = Enable_if<Matrix_type<M>()>>
+  explicit CsrMatrix(const M &x);
+
+  //! number of dimensions
+  static constexpr std::size_t order() { return order_; }
+
+  std::size_t n_rows() const { return rows_; }
+  std::size_t n_cols() const { return cols_; }
+
+  //! number of stored non-zeros
+  std::size_t nnz() const { return vals_.size(); }
+
+  //! the compressed arrays
+  ///@{
+  const std::vector<std::size_t> &row_ptr() const { return ptr_; }
+  const std::vector<std::size_t> &col_indices() const { return col_; }
+  const std::vector<T> &values() const { return vals_; }
+  std::vector<T> &values() { return vals_; }
+  ///@}
+
+  //! m(i, j), zero when not stored. O(log nnz(i)).
+  T operator()(std::size_t i, std::size_t j) const {
+    assert(i < rows_ && j < cols_);
+    auto first = col_.begin() + ptr_[i], last = col_.begin() + ptr_[i + 1];
+    auto it = std::lower_bound(first, last, j);
+    return it != last && *it == j ? vals_[it - col_.begin()] : T{};
+  }
+
+  //! dense copy
+  Matrix<T, 2> to_matrix() const {
+    Matrix<T, 2> m(rows_, cols_);
+    for (std::size_t i = 0; i != rows_; ++i)
+      for (std::size_t k = ptr_[i]; k != ptr_[i + 1]; ++k)
+        m(i, col_[k]) = vals_[k];
+    return m;
+  }
+
+  //! Split the rows into at most n consecutive blocks holding about the same
+  //! number of non-zeros. Block b is rows [r[b], r[b + 1]).
+  std::vector<std::size_t> row_blocks(std::size_t n) const {
+    n = std::max<std::size_t>(1, std::min(n, rows_));
+    std::vector<std::size_t> r(n + 1, rows_);
+    r[0] = 0;
+    for (std::size_t b = 1; b != n; ++b) {
+      const std::size_t target = nnz() * b / n;
+      r[b] = std::upper_bound(ptr_.begin(), ptr_.end(), target) -
+             ptr_.begin() - 1;
+      r[b] = std::max(r[b], r[b - 1]);
+    }
+    return r;
+  }
+
+private:
+  std::size_t rows_, cols_;
+  std::vector<std::size_t> ptr_; // rows_ + 1 offsets into col_ and vals_
+  std::vector<std::size_t> col_;
+  std::vector<T> vals_;
+};
+
+// Bucket the triplets by row with a parallel counting sort: every chunk of
+// triplets counts its rows, the counts are turned into per-chunk write
+// positions, and every chunk scatters its own triplets. The rows are then
+// sorted by column and their duplicates summed, also in parallel.
+template <typename T> CsrMatrix<T>::CsrMatrix(const CooMatrix<T> &coo)
+    : rows_{coo.n_rows()}, cols_{coo.n_cols()}, ptr_(coo.n_rows() + 1, 0) {
+  const std::vector<std::size_t> &ri = coo.row_indices();
+  const std::vector<std::size_t> &ci = coo.col_indices();
+  const std::vector<T> &vi = coo.values();
+  const std::size_t n = vi.size();
+  const std::size_t chunks = std::max<std::size_t>(
+      1, std::min(matrix_impl::thread_count(), n / 65536));
+
+  // pos[c][i]: where chunk c writes its next triplet of row i
+  std::vector<std::vector<std::size_t>> pos(chunks);
+  matrix_impl::parallel_tasks(chunks, [&](std::size_t c) {
+    pos[c].assign(rows_, 0);
+    for (std::size_t k = n * c / chunks; k != n * (c + 1) / chunks; ++k)
+      ++pos[c][ri[k]];
+  });
+  std::size_t next = 0;
+  for (std::size_t i = 0; i != rows_; ++i) {
+    ptr_[i] = next;
+    for (std::size_t c = 0; c != chunks; ++c) {
+      const std::size_t count = pos[c][i];
+      pos[c][i] = next;
+      next += count;
+    }
+  }
+  ptr_[rows_] = next;
+
+  std::vector<std::pair<std::size_t, T>> entries(n);
+  matrix_impl::parallel_tasks(chunks, [&](std::size_t c) {
+    for (std::size_t k = n * c / chunks; k != n * (c + 1) / chunks; ++k)
+      entries[pos[c][ri[k]]++] = std::make_pair(ci[k], vi[k]);
+  });
+
+  // sort every row and count its distinct columns
+  std::vector<std::size_t> unique(rows_ + 1, 0);
+  matrix_impl::parallel_for(0, rows_, 1024, [&](std::size_t a, std::size_t b) {
+    for (std::size_t i = a; i != b; ++i) {
+      auto first = entries.begin() + ptr_[i];
+      auto last = entries.begin() + ptr_[i + 1];
+      std::sort(first, last, [](const std::pair<std::size_t, T> &x,
+                                const std::pair<std::size_t, T> &y) {
+        return x.first < y.first;
+      });
+      for (auto it = first; it != last; ++it)
+        unique[i + 1] += it == first || it->first != (it - 1)->first;
+    }
+  });
+  std::partial_sum(unique.begin(), unique.end(), unique.begin());
+
+  col_.resize(unique[rows_]);
+  vals_.resize(unique[rows_]);
+  matrix_impl::parallel_for(0, rows_, 1024, [&](std::size_t a, std::size_t b) {
+    for (std::size_t i = a; i != b; ++i) {
+      std::size_t out = unique[i];
+      for (std::size_t k = ptr_[i]; k != ptr_[i + 1]; ++k) {
+        if (k != ptr_[i] && entries[k].first == entries[k - 1].first) {
+          vals_[out - 1] += entries[k].second;
+          continue;
+        }
+        col_[out] = entries[k].first;
+        vals_[out] = entries[k].second;
+        ++out;
+      }
+    }
+  });
+  ptr_.swap(unique);
+}
+
+template <typename T>
+template <typename M, typename>
+CsrMatrix<T>::CsrMatrix(const M &x)
+    : rows_{x.n_rows()}, cols_{x.n_cols()}, ptr_(x.n_rows() + 1, 0) {
+  static_assert(M::order() == 2, "CsrMatrix: order mismatch");
+  const MatrixSlice<2> &d = x.descriptor();
+  const typename M::value_type *p = x.data() + d.start;
+
+  // count the non-zeros of every row, then copy them out
+  matrix_impl::parallel_for(0, rows_, 256, [&](std::size_t a, std::size_t b) {
+    for (std::size_t i = a; i != b; ++i)
+      for (std::size_t j = 0; j != cols_; ++j)
+        ptr_[i + 1] += p[i * d.strides[0] + j * d.strides[1]] != T{};
+  });
+  std::partial_sum(ptr_.begin(), ptr_.end(), ptr_.begin());
+
+  col_.resize(ptr_[rows_]);
+  vals_.resize(ptr_[rows_]);
+  matrix_impl::parallel_for(0, rows_, 256, [&](std::size_t a, std::size_t b) {
+    for (std::size_t i = a; i != b; ++i) {
+      std::size_t out = ptr_[i];
+      for (std::size_t j = 0; j != cols_; ++j) {
+        const T v = p[i * d.strides[0] + j * d.strides[1]];
+        if (v != T{}) {
+          col_[out] = j;
+          vals_[out++] = v;
+        }
+      }
+    }
+  });
+}
+
+//! y = a x. The rows are split into blocks of equal non-zero count, one per
+//! thread.
+template <typename T, typename V>
+Enable_if<Matrix_type<V>(), Matrix<T, 1>> spmv(const CsrMatrix<T> &a,
+                                               const V &x) {
+  MATRIX_TIMED("spmv");
+  static_assert(V::order() == 1, "spmv: x must be 1-D");
+  assert(x.extent(0) == a.n_cols());
+
+  const Matrix<T, 1> xd(x); // dense copy for the random reads
+  const T *xv = xd.data();
+  const std::size_t *ptr = a.row_ptr().data(), *col = a.col_indices().data();
+  const T *val = a.values().data();
+  Matrix<T, 1> y(a.n_rows());
+  T *yv = y.data();
+
+  const std::vector<std::size_t> blocks =
+      a.row_blocks(std::min(matrix_impl::thread_count(), a.nnz() / 16384 + 1));
+  matrix_impl::parallel_tasks(blocks.size() - 1, [&](std::size_t b) {
+    for (std::size_t i = blocks[b]; i != blocks[b + 1]; ++i) {
+      T s = T{};
+      for (std::size_t k = ptr[i]; k != ptr[i + 1]; ++k)
+        s += val[k] * xv[col[k]];
+      yv[i] = s;
+    }
+  });
+  return y;
+}
+
+//! c = a b with a dense b. Row i of c accumulates whole rows of b, so the
+//! inner loop is a unit-stride axpy when the rows of b are dense. Rows are
+//! split as in spmv.
+template <typename T, typename M>
+Enable_if<Matrix_type<M>(), Matrix<T, 2>> spmm(const CsrMatrix<T> &a,
+                                               const M &b) {
+  MATRIX_TIMED("spmm");
+  static_assert(M::order() == 2, "spmm: b must be 2-D");
+  assert(b.n_rows() == a.n_cols());
+
+  const MatrixSlice<2> &bd = b.descriptor();
+  const typename M::value_type *bp = b.data() + bd.start;
+  const std::size_t bs0 = bd.strides[0], bs1 = bd.strides[1];
+  const std::size_t n = b.n_cols();
+  const std::size_t *ptr = a.row_ptr().data(), *col = a.col_indices().data();
+  const T *val = a.values().data();
+  Matrix<T, 2> c(a.n_rows(), n);
+  T *cp = c.data();
+
+  const std::vector<std::size_t> blocks = a.row_blocks(
+      std::min(matrix_impl::thread_count(), a.nnz() * n / 16384 + 1));
+  matrix_impl::parallel_tasks(blocks.size() - 1, [&](std::size_t blk) {
+    for (std::size_t i = blocks[blk]; i != blocks[blk + 1]; ++i) {
+      T *ci = cp + i * n;
+      for (std::size_t k = ptr[i]; k != ptr[i + 1]; ++k) {
+        const T v = val[k];
+        const typename M::value_type *bj = bp + col[k] * bs0;
+        if (bs1 == 1)
+          for (std::size_t j = 0; j != n; ++j)
+            ci[j] += v * bj[j];
+        else
+          for (std::size_t j = 0; j != n; ++j)
+            ci[j] += v * bj[j * bs1];
+      }
+    }
+  });
+  return c;
+}
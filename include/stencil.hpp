@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+//! how a stencil reads the elements outside its input
+enum class boundary {
+  zero,  //!< everything outside reads as 0
+  clamp, //!< repeat the nearest edge element
+  wrap   //!< periodic continuation
+};
+
+namespace stencil_impl {
+// Output tile, in elements. A 64 x 256 float tile plus its halo stays in L2
+// and every row of it in L1.
+constexpr std::size_t tile_rows = 64;
+constexpr std::size_t tile_cols = 256;
+
+// Map a possibly out of range index onto [0, n) following b. -1 means that
+// the element reads as zero.
+inline std::ptrdiff_t map_index(std::ptrdiff_t i, std::ptrdiff_t n,
+                                boundary b) {
+  if (i >= 0 && i < n)
+    return i;
+  switch (b) {
+  case boundary::clamp:
+    return i < 0 ? 0 : n - 1;
+  case boundary::wrap:
+    return ((i % n) + n) % n;
+  default:
+    return -1;
+  }
+}
+
+// The 2-D planes a stencil runs over: the matrix itself, or every m[c] of a
+// 3-D matrix (planes x rows x columns)
+inline std::vector<MatrixSlice<2>> planes(const MatrixSlice<2> &d) {
+  return {d};
+}
+
+inline std::vector<MatrixSlice<2>> planes(const MatrixSlice<3> &d) {
+  std::vector<MatrixSlice<2>> v(d.extents[0]);
+  for (std::size_t c = 0; c != v.size(); ++c)
+    matrix_impl::slice_dim<0>(c, d, v[c]);
+  return v;
+}
+
+template <typename T> Matrix<T, 2> make_like(const MatrixSlice<2> &d) {
+  return Matrix<T, 2>(d.extents[0], d.extents[1]);
+}
+
+template <typename T> Matrix<T, 3> make_like(const MatrixSlice<3> &d) {
+  return Matrix<T, 3>(d.extents[0], d.extents[1], d.extents[2]);
+}
+
+// Copy the th x tw tile at (i0, j0) of the plane (d, p), plus the halo read
+// by a kh x kw kernel centred at (kh / 2, kw / 2), into buf. Rows of buf are
+// tw + kw - 1 long and reads outside the plane are resolved with b. The tile
+// is dense afterwards whatever the strides of the plane, so the kernels below
+// only see unit-stride rows.
+template <typename T>
+void gather_tile(const MatrixSlice<2> &d, const T *p, std::ptrdiff_t i0,
+                 std::ptrdiff_t j0, std::size_t th, std::size_t tw,
+                 std::size_t kh, std::size_t kw, boundary b, T *buf) {
+  const std::ptrdiff_t rows = d.extents[0], cols = d.extents[1];
+  const std::ptrdiff_t top = i0 - std::ptrdiff_t(kh / 2);
+  const std::ptrdiff_t lo = j0 - std::ptrdiff_t(kw / 2);
+  const std::ptrdiff_t hi = lo + std::ptrdiff_t(tw + kw - 1);
+  const std::ptrdiff_t first = std::max<std::ptrdiff_t>(lo, 0);
+  const std::ptrdiff_t last = std::min(hi, cols);
+  const std::size_t pitch = tw + kw - 1;
+
+  for (std::size_t r = 0; r != th + kh - 1; ++r) {
+    T *dst = buf + r * pitch; // column j of the plane is dst[j - lo]
+    const std::ptrdiff_t i = map_index(top + std::ptrdiff_t(r), rows, b);
+    if (i < 0) {
+      std::fill(dst, dst + pitch, T{});
+      continue;
+    }
+
+    const T *src = p + d.start + i * d.strides[0];
+    const std::size_t cs = d.strides[1];
+    if (cs == 1)
+      std::copy(src + first, src + last, dst + (first - lo));
+    else
+      for (std::ptrdiff_t j = first; j != last; ++j)
+        dst[j - lo] = src[j * cs];
+
+    for (std::ptrdiff_t j = lo; j != first; ++j) {
+      const std::ptrdiff_t k = map_index(j, cols, b);
+      dst[j - lo] = k < 0 ? T{} : src[k * cs];
+    }
+    for (std::ptrdiff_t j = last; j != hi; ++j) {
+      const std::ptrdiff_t k = map_index(j, cols, b);
+      dst[j - lo] = k < 0 ? T{} : src[k * cs];
+    }
+  }
+}
+
+// out(r, j) = sum_ab k(a, b) buf(r + a, j + b) for a th x tw tile. The inner
+// loop runs along a dense row of both sides, so it vectorizes.
+template <typename T>
+void correlate_tile(const T *buf, std::size_t pitch, const T *k,
+                    std::size_t kh, std::size_t kw, std::size_t th,
+                    std::size_t tw, T *out, std::size_t out_pitch) {
+  for (std::size_t r = 0; r != th; ++r) {
+    T *o = out + r * out_pitch;
+    std::fill(o, o + tw, T{});
+    for (std::size_t a = 0; a != kh; ++a) {
+      const T *row = buf + (r + a) * pitch;
+      for (std::size_t b = 0; b != kw; ++b) {
+        const T w = k[a * kw + b];
+        if (w == T{})
+          continue;
+        const T *s = row + b;
+        for (std::size_t j = 0; j != tw; ++j)
+          o[j] += w * s[j];
+      }
+    }
+  }
+}
+
+// Both passes of a separable kernel on one tile. The horizontal pass fills
+// tmp (th + kh - 1 rows of tw) and the vertical pass reads it back while it
+// is still in cache, so the intermediate image never reaches memory.
+template <typename T>
+void separable_tile(const T *buf, std::size_t pitch, const T *ky,
+                    std::size_t kh, const T *kx, std::size_t kw,
+                    std::size_t th, std::size_t tw, T *tmp, T *out,
+                    std::size_t out_pitch) {
+  for (std::size_t r = 0; r != th + kh - 1; ++r) {
+    T *h = tmp + r * tw;
+    std::fill(h, h + tw, T{});
+    for (std::size_t b = 0; b != kw; ++b) {
+      const T w = kx[b];
+      const T *s = buf + r * pitch + b;
+      for (std::size_t j = 0; j != tw; ++j)
+        h[j] += w * s[j];
+    }
+  }
+  for (std::size_t r = 0; r != th; ++r) {
+    T *o = out + r * out_pitch;
+    std::fill(o, o + tw, T{});
+    for (std::size_t a = 0; a != kh; ++a) {
+      const T w = ky[a];
+      const T *s = tmp + (r + a) * tw;
+      for (std::size_t j = 0; j != tw; ++j)
+        o[j] += w * s[j];
+    }
+  }
+}
+
+// Run f(in_plane, out_plane, i0, j0, th, tw, buffers) over every tile of every
+// plane, in parallel. Each chunk of tiles owns its scratch buffers.
+template <typename T, std::size_t N, typename F>
+void for_each_tile(const MatrixSlice<N> &in, Matrix<T, N> &out,
+                   std::size_t kh, std::size_t kw, F f) {
+  const std::vector<MatrixSlice<2>> ip = planes(in);
+  const std::vector<MatrixSlice<2>> op = planes(out.descriptor());
+  if (ip.empty())
+    return;
+  const std::size_t rows = ip[0].extents[0], cols = ip[0].extents[1];
+  const std::size_t tr = (rows + tile_rows - 1) / tile_rows;
+  const std::size_t tc = (cols + tile_cols - 1) / tile_cols;
+  const std::size_t per_plane = tr * tc;
+
+  matrix_impl::parallel_for(
+      0, ip.size() * per_plane, 1, [&](std::size_t first, std::size_t last) {
+        std::vector<T> buf((tile_rows + kh - 1) * (tile_cols + kw - 1));
+        std::vector<T> tmp((tile_rows + kh - 1) * tile_cols);
+        for (std::size_t t = first; t != last; ++t) {
+          const std::size_t c = t / per_plane, tile = t % per_plane;
+          const std::size_t i0 = tile / tc * tile_rows;
+          const std::size_t j0 = tile % tc * tile_cols;
+          f(ip[c], op[c], i0, j0, std::min(tile_rows, rows - i0),
+            std::min(tile_cols, cols - j0), buf.data(), tmp.data());
+        }
+      });
+}
+} // namespace stencil_impl
+
+//! Correlate a 2-D matrix, or every plane m[c] of a 3-D one, with a 2-D
+//! kernel: out(i, j) = sum_ab k(a, b) in(i + a - kh / 2, j + b - kw / 2).
+//! The kernel is not flipped, as in most image libraries. Reads outside the
+//! input follow b.
+template <typename M, typename K>
+Enable_if<Matrix_type<M>() && Matrix_type<K>(),
+          Matrix<typename std::remove_const<typename M::value_type>::type,
+                 M::order()>>
+convolve(const M &in, const K &kernel, boundary b = boundary::zero) {
+  MATRIX_TIMED("convolve");
+  using T = typename std::remove_const<typename M::value_type>::type;
+  static_assert(M::order() == 2 || M::order() == 3,
+                "convolve: only 2-D and 3-D matrices");
+  static_assert(K::order() == 2, "convolve: the kernel must be 2-D");
+
+  const Matrix<T, 2> k(kernel); // dense, row-major copy of the taps
+  const std::size_t kh = k.n_rows(), kw = k.n_cols();
+  auto out = stencil_impl::make_like<T>(in.descriptor());
+  const T *p = in.data();
+  T *q = out.data();
+
+  stencil_impl::for_each_tile(
+      in.descriptor(), out, kh, kw,
+      [&](const MatrixSlice<2> &id, const MatrixSlice<2> &od, std::size_t i0,
+          std::size_t j0, std::size_t th, std::size_t tw, T *buf, T *) {
+        stencil_impl::gather_tile(id, p, i0, j0, th, tw, kh, kw, b, buf);
+        stencil_impl::correlate_tile(
+            buf, tw + kw - 1, k.data(), kh, kw, th, tw,
+            q + od.start + i0 * od.strides[0] + j0, od.strides[0]);
+      });
+  return out;
+}
+
+//! Correlate with the separable kernel ky (vertical) x kx (horizontal), that
+//! is with the 2-D kernel k(a, b) = ky(a) kx(b), in a single fused pass.
+template <typename M, typename V, typename H>
+Enable_if<Matrix_type<M>() && Matrix_type<V>() && Matrix_type<H>(),
+          Matrix<typename std::remove_const<typename M::value_type>::type,
+                 M::order()>>
+convolve_separable(const M &in, const V &ky, const H &kx,
+                   boundary b = boundary::zero) {
+  MATRIX_TIMED("convolve_separable");
+  using T = typename std::remove_const<typename M::value_type>::type;
+  static_assert(M::order() == 2 || M::order() == 3,
+                "convolve_separable: only 2-D and 3-D matrices");
+  static_assert(V::order() == 1 && H::order() == 1,
+                "convolve_separable: the kernels must be 1-D");
+
+  const Matrix<T, 1> v(ky), h(kx);
+  const std::size_t ny = v.size(), nx = h.size();
+  auto out = stencil_impl::make_like<T>(in.descriptor());
+  const T *p = in.data();
+  T *q = out.data();
+
+  stencil_impl::for_each_tile(
+      in.descriptor(), out, ny, nx,
+      [&](const MatrixSlice<2> &id, const MatrixSlice<2> &od, std::size_t i0,
+          std::size_t j0, std::size_t th, std::size_t tw, T *buf, T *tmp) {
+        stencil_impl::gather_tile(id, p, i0, j0, th, tw, ny, nx, b, buf);
+        stencil_impl::separable_tile(
+            buf, tw + nx - 1, v.data(), ny, h.data(), nx, th, tw, tmp,
+            q + od.start + i0 * od.strides[0] + j0, od.strides[0]);
+      });
+  return out;
+}
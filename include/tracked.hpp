@@ -0,0 +1,268 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "matrix.hpp"
+
+// A 2-D row-major Matrix that records which rows were written since a given
+// point, so that results derived from it can be brought up to date by
+// recomputing only those rows.
+//
+// Every non-const access marks the rows it can reach: operator()(i, j),
+// row(), rows(), slicing, apply() and data(). Const access does not, so
+// read through a const reference (or matrix()) where possible. A mark
+// stamps the row with a new value of a clock. A cache remembers the clock
+// of its last refresh, and its next query recomputes the rows stamped
+// after that.
+//
+// The caches (RowCache, ColumnCache) point to their TrackedMatrix, which
+// must outlive them and not move.
+
+template <typename T> class TrackedMatrix {
+public:
+  using value_type = T;
+
+  //! specify the extents
+  TrackedMatrix(std::size_t rows, std::size_t cols)
+      : m_(rows, cols), stamp_(rows, 1), clock_{1} {}
+
+  //! take over the elements of m
+  explicit TrackedMatrix(Matrix<T, 2> m)
+      : m_(std::move(m)), stamp_(m_.n_rows(), 1), clock_{1} {}
+
+  std::size_t n_rows() const { return m_.n_rows(); }
+  std::size_t n_cols() const { return m_.n_cols(); }
+  std::size_t size() const { return m_.size(); }
+
+  //! the elements, read only (no marking)
+  const Matrix<T, 2> &matrix() const { return m_; }
+
+  //! m(i, j), marking row i when non-const
+  ///@{
+  T &operator()(std::size_t i, std::size_t j) {
+    mark(i);
+    return m_(i, j);
+  }
+  const T &operator()(std::size_t i, std::size_t j) const { return m_(i, j); }
+  ///@}
+
+  //! row access, marking row n when non-const
+  ///@{
+  ContiguousRef<T, 1> row(std::size_t n) {
+    mark(n);
+    return m_.row(n);
+  }
+  ContiguousRef<const T, 1> row(std::size_t n) const { return m_.row(n); }
+  ContiguousRef<T, 1> operator[](std::size_t n) { return row(n); }
+  ContiguousRef<const T, 1> operator[](std::size_t n) const { return row(n); }
+  ///@}
+
+  //! rows i to j, marking them when non-const
+  ///@{
+  ContiguousRef<T, 2> rows(std::size_t i, std::size_t j) {
+    mark(i, j + 1);
+    return m_.rows(i, j);
+  }
+  ContiguousRef<const T, 2> rows(std::size_t i, std::size_t j) const {
+    return m_.rows(i, j);
+  }
+  ///@}
+
+  //! m(s1, s2) slicing, marking the rows the slice spans when non-const
+  ///@{
+  template <typename... Args>
+  Enable_if<matrix_impl::Requesting_slice<Args...>(), MatrixRef<T, 2>>
+  operator()(const Args &...args) {
+    MatrixRef<T, 2> r = m_(args...);
+    const MatrixSlice<2> &d = r.descriptor();
+    if (d.size != 0) {
+      const std::size_t first = d.start / m_.descriptor().strides[0];
+      mark(first, first + (d.extents[0] - 1) * d.strides[0] /
+                              m_.descriptor().strides[0] + 1);
+    }
+    return r;
+  }
+
+  template <typename... Args>
+  Enable_if<matrix_impl::Requesting_slice<Args...>(), MatrixRef<const T, 2>>
+  operator()(const Args &...args) const {
+    return m_(args...);
+  }
+  ///@}
+
+  //! f(x) for every element x, marking every row
+  template <typename F> TrackedMatrix &apply(F f) {
+    mark_all();
+    m_.apply(f);
+    return *this;
+  }
+
+  //! f(x, mx) for corresponding elements of *this and m, marking every row
+  template <typename M, typename F>
+  Enable_if<Matrix_type<M>(), TrackedMatrix &> apply(const M &m, F f) {
+    mark_all();
+    m_.apply(m, f);
+    return *this;
+  }
+
+  //! "flat" element access; the non-const one marks every row
+  ///@{
+  T *data() {
+    mark_all();
+    return m_.data();
+  }
+  const T *data() const { return m_.data(); }
+  ///@}
+
+  //! mark rows by hand, e.g. after writing through a kept reference
+  ///@{
+  void mark(std::size_t i) {
+    assert(i < n_rows());
+    stamp_[i] = ++clock_;
+  }
+  void mark(std::size_t first, std::size_t last) {
+    assert(first <= last && last <= n_rows());
+    ++clock_;
+    std::fill(stamp_.begin() + first, stamp_.begin() + last, clock_);
+  }
+  void mark_all() { mark(0, n_rows()); }
+  ///@}
+
+  //! the clock, which every mark advances
+  std::uint64_t clock() const { return clock_; }
+
+  //! whether row i was marked after the clock read since
+  bool dirty(std::size_t i, std::uint64_t since) const {
+    return stamp_[i] > since;
+  }
+
+private:
+  Matrix<T, 2> m_;
+  std::vector<std::uint64_t> stamp_; // clock of the last mark of each row
+  std::uint64_t clock_;
+};
+
+namespace tracked_impl {
+template <typename T>
+const T *row_data(const TrackedMatrix<T> &m, std::size_t i) {
+  return m.data() + i * m.n_cols();
+}
+} // namespace tracked_impl
+
+//! The value f(p, n) of every row of a TrackedMatrix, p pointing to the n
+//! elements of the row. A query recomputes the rows marked since the last
+//! one. Made by track_rows().
+template <typename T, typename F> class RowCache {
+public:
+  using result_type = decltype(std::declval<F>()(
+      std::declval<const T *>(), std::declval<std::size_t>()));
+
+  RowCache(const TrackedMatrix<T> &m, F f)
+      : m_(&m), f_(f), values_(m.n_rows()), seen_{0}, refreshed_{0} {}
+
+  //! the value of every row, brought up to date
+  const std::vector<result_type> &values() {
+    const std::uint64_t now = m_->clock();
+    if (now == seen_)
+      return values_;
+    refreshed_ = 0;
+    for (std::size_t i = 0; i != values_.size(); ++i)
+      if (m_->dirty(i, seen_)) {
+        values_[i] = f_(tracked_impl::row_data(*m_, i), m_->n_cols());
+        ++refreshed_;
+      }
+    seen_ = now;
+    return values_;
+  }
+
+  //! rows recomputed by the last query that found marked rows
+  std::size_t refreshed() const { return refreshed_; }
+
+private:
+  const TrackedMatrix<T> *m_;
+  F f_;
+  std::vector<result_type> values_;
+  std::uint64_t seen_;
+  std::size_t refreshed_;
+};
+
+//! A fold of every column of a TrackedMatrix with op, from init: column j
+//! gives op(...op(op(init, m(0, j)), m(1, j))..., m(rows - 1, j)). op must
+//! be associative and also combine two partial results, like + or max. The
+//! rows are grouped in blocks whose partial folds are kept, so a query
+//! refolds the blocks holding marked rows and then combines the partials.
+//! Made by track_columns().
+template <typename T, typename R, typename Op> class ColumnCache {
+public:
+  ColumnCache(const TrackedMatrix<T> &m, R init, Op op, std::size_t block)
+      : m_(&m), init_(init), op_(op), block_(std::max<std::size_t>(block, 1)),
+        blocks_((m.n_rows() + block_ - 1) / block_),
+        partial_(blocks_ * m.n_cols(), init), values_(m.n_cols(), init),
+        seen_{0}, refreshed_{0} {}
+
+  //! the fold of every column, brought up to date
+  const std::vector<R> &values() {
+    const std::uint64_t now = m_->clock();
+    if (now == seen_)
+      return values_;
+    const std::size_t rows = m_->n_rows(), cols = m_->n_cols();
+    refreshed_ = 0;
+    for (std::size_t b = 0; b != blocks_; ++b) {
+      const std::size_t first = b * block_;
+      const std::size_t last = std::min(rows, first + block_);
+      bool dirty = false;
+      for (std::size_t i = first; i != last && !dirty; ++i)
+        dirty = m_->dirty(i, seen_);
+      if (!dirty)
+        continue;
+      R *part = partial_.data() + b * cols;
+      std::fill(part, part + cols, init_);
+      for (std::size_t i = first; i != last; ++i) {
+        const T *p = tracked_impl::row_data(*m_, i);
+        for (std::size_t j = 0; j != cols; ++j)
+          part[j] = op_(part[j], R(p[j]));
+      }
+      refreshed_ += last - first;
+    }
+    std::fill(values_.begin(), values_.end(), init_);
+    for (std::size_t b = 0; b != blocks_; ++b) {
+      const R *part = partial_.data() + b * cols;
+      for (std::size_t j = 0; j != cols; ++j)
+        values_[j] = op_(values_[j], part[j]);
+    }
+    seen_ = now;
+    return values_;
+  }
+
+  //! rows refolded by the last query that found marked rows
+  std::size_t refreshed() const { return refreshed_; }
+
+private:
+  const TrackedMatrix<T> *m_;
+  R init_;
+  Op op_;
+  std::size_t block_, blocks_;
+  std::vector<R> partial_; // blocks_ x cols partial folds
+  std::vector<R> values_;
+  std::uint64_t seen_;
+  std::size_t refreshed_;
+};
+
+//! cache f(p, n) for every row of m (see RowCache)
+template <typename T, typename F>
+RowCache<T, F> track_rows(const TrackedMatrix<T> &m, F f) {
+  return {m, f};
+}
+
+//! cache the fold of every column of m with op from init, keeping partial
+//! folds per block of rows (see ColumnCache)
+template <typename T, typename R, typename Op>
+ColumnCache<T, R, Op> track_columns(const TrackedMatrix<T> &m, R init, Op op,
+                                    std::size_t block_rows = 64) {
+  return {m, init, op, block_rows};
+}
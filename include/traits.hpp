@@ -7,6 +7,20 @@ template <typename X, typename Y> constexpr bool Same() {
   return std::is_same<X, Y>::value;
 }
 
+constexpr bool All() { return true; }
+
+template <typename... Args> constexpr bool All(bool b, Args... args) {
+  return b && All(args...);
+}
+
+constexpr bool Some() { return false; }
+
+template <typename... Args> constexpr bool Some(bool b, Args... args) {
+  return b || Some(args...);
+}
+
+template <typename T> void ignore(const T &) {}
+
 template <bool B, typename T = void>
 using Enable_if = typename std::enable_if<B, T>::type;
 
@@ -14,6 +28,12 @@ template <typename X, typename Y> constexpr bool Convertible() {
   return std::is_convertible<X, Y>::value;
 }
 
+//! The type arithmetic on T is carried out and accumulated in: T itself,
+//! except for storage-only types such as half (see half.hpp)
+template <typename T> struct accumulator { using type = T; };
+
+template <typename T> using Accumulator = typename accumulator<T>::type;
+
 struct substitution_failure {};
 
 template <typename T> struct substitution_succeeded : std::true_type {};
@@ -22,8 +42,9 @@ template <>
 struct substitution_succeeded<substitution_failure> : std::false_type {};
 
 template <typename M> struct get_matrix_type_result {
-  template <typename T, size_t N, typename = Enable_if<(N >= 1)>>
-  static bool check(const Matrix<T, N> &m);
+  template <typename T, size_t N, typename L,
+            typename = Enable_if<(N >= 1) && L::strided>>
+  static bool check(const Matrix<T, N, L> &m);
 
   template <typename T, size_t N, typename = Enable_if<(N >= 1)>>
   static bool check(const MatrixRef<T, N> &m);
@@ -44,3 +65,19 @@ template <typename M> constexpr bool Has_matrix_type() {
 template <typename M> constexpr bool Matrix_type() {
   return Has_matrix_type<M>();
 }
+
+//! True when the last dimension of M is statically known to have stride 1:
+//! Matrix with a unit_stride layout and ContiguousRef
+template <typename M> struct is_unit_stride : std::false_type {};
+
+template <typename T, size_t N, typename L>
+struct is_unit_stride<Matrix<T, N, L>>
+    : std::integral_constant<bool, L::unit_stride> {};
+
+template <typename T, size_t N>
+struct is_unit_stride<ContiguousRef<T, N>> : std::true_type {};
+
+template <typename M> constexpr bool Unit_stride() {
+  return is_unit_stride<typename std::remove_cv<
+      typename std::remove_reference<M>::type>::type>::value;
+}
@@ -1,10 +1,928 @@
 #include <gtest/gtest.h>
 
+#include "concurrent.hpp"
+#include "csv.hpp"
+#include "dispatch.hpp"
+#include "fft.hpp"
+#include "indexing.hpp"
+#include "instrument.hpp"
+#include "matrix.hpp"
+#include "matrix_ops.hpp"
+#include "packed.hpp"
+#include "quantized.hpp"
+#include "random.hpp"
+#include "rolling.hpp"
+#include "sort.hpp"
+#include "sparse.hpp"
+#include "stencil.hpp"
+#include "tracked.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
 // Example test case
 TEST(MyProjectTest, ExampleTest) {
     EXPECT_EQ(2 + 2, 4);
 }
 
+TEST(LayoutTest, ColumnMajorStorageOrder) {
+    Matrix<int, 2, column_major> m = {{1, 2, 3}, {4, 5, 6}};
+    EXPECT_EQ(m.descriptor().strides[0], 1u);
+    EXPECT_EQ(m.descriptor().strides[1], 2u);
+    EXPECT_EQ(m(1, 2), 6);
+    EXPECT_EQ(std::vector<int>(m.begin(), m.end()),
+              (std::vector<int>{1, 4, 2, 5, 3, 6}));
+    EXPECT_EQ(m.col(1)(1), 5);
+}
+
+TEST(LayoutTest, ConversionsKeepElements) {
+    Matrix<int, 2> m(37, 53);
+    int k = 0;
+    for (auto &x : m)
+        x = k++;
+
+    Matrix<int, 2, column_major> c(m);
+    Matrix<int, 2, tiled<8>> t(c);
+    Matrix<int, 2> back(t);
+    for (std::size_t i = 0; i != m.n_rows(); ++i)
+        for (std::size_t j = 0; j != m.n_cols(); ++j) {
+            EXPECT_EQ(c(i, j), m(i, j));
+            EXPECT_EQ(t(i, j), m(i, j));
+            EXPECT_EQ(back(i, j), m(i, j));
+        }
+    EXPECT_EQ(t.size(), m.size());
+}
+
+TEST(LayoutTest, TilesAreDenseViews) {
+    Matrix<int, 2> m(20, 20);
+    int k = 0;
+    for (auto &x : m)
+        x = k++;
+
+    Matrix<int, 2, tiled<16>> t(m);
+    auto corner = t.tile(1, 1);
+    EXPECT_EQ(corner.n_rows(), 4u);
+    EXPECT_EQ(corner.n_cols(), 4u);
+    EXPECT_EQ(corner(3, 3), m(19, 19));
+    EXPECT_EQ(corner.data() + corner.descriptor().start, &t(16, 16));
+}
+
+TEST(ViewTest, RowsOfRowMajorAreContiguous) {
+    Matrix<int, 2> m = {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}};
+    const Matrix<int, 2> &cm = m;
+    Matrix<int, 2, column_major> c(m);
+    static_assert(Same<decltype(m[1]), ContiguousRef<int, 1>>(), "");
+    static_assert(Same<decltype(cm.rows(0, 1)), ContiguousRef<const int, 2>>(),
+                  "");
+    static_assert(Same<decltype(m.col(1)), MatrixRef<int, 1>>(), "");
+    static_assert(Same<decltype(c[1]), MatrixRef<int, 1>>(), "");
+    static_assert(Same<ContiguousRef<int, 1>::iterator, int *>(), "");
+    static_assert(Unit_stride<Matrix<int, 2>>() &&
+                      Unit_stride<ContiguousRef<int, 2>>() &&
+                      !Unit_stride<Matrix<int, 2, column_major>>() &&
+                      !Unit_stride<MatrixRef<int, 2>>(),
+                  "");
+
+    int s = 0;
+    for (int x : m[1])
+        s += x;
+    EXPECT_EQ(s, 15);
+    m.rows(1, 2)[1].apply([](int &x) { x *= 10; });
+    EXPECT_EQ(m(2, 0), 70);
+    EXPECT_EQ(c.row(1)(2), 6);
+}
+
+TEST(ViewTest, BlockIteratorsMatchStridedViews) {
+    Matrix<int, 3> m(3, 4, 5);
+    int k = 0;
+    for (auto &x : m)
+        x = k++;
+
+    auto block = m.cols(1, 2);
+    MatrixRef<int, 3> strided(block.descriptor(), block.data());
+    EXPECT_EQ(std::vector<int>(block.begin(), block.end()),
+              std::vector<int>(strided.begin(), strided.end()));
+
+    Matrix<int, 3> twice(block);
+    twice.apply(block, [](int &x, int y) { x += y; });
+    block.apply(twice, [](int &x, int y) { x = y - x; });
+    EXPECT_EQ(std::vector<int>(block.begin(), block.end()),
+              std::vector<int>(strided.begin(), strided.end()));
+    EXPECT_EQ(m(2, 1, 4), 2 * 20 + 1 * 5 + 4);
+}
+
+TEST(StencilTest, BoundaryModes) {
+    Matrix<int, 2> m = {{1, 2, 3}, {4, 5, 6}};
+    Matrix<int, 2> left = {{1, 0, 0}}; // out(i, j) = in(i, j - 1)
+    using v = std::vector<int>;
+
+    auto z = convolve(m, left, boundary::zero);
+    EXPECT_EQ(v(z.begin(), z.end()), (v{0, 1, 2, 0, 4, 5}));
+    auto c = convolve(m, left, boundary::clamp);
+    EXPECT_EQ(v(c.begin(), c.end()), (v{1, 1, 2, 4, 4, 5}));
+    auto w = convolve(m, left, boundary::wrap);
+    EXPECT_EQ(v(w.begin(), w.end()), (v{3, 1, 2, 6, 4, 5}));
+}
+
+TEST(StencilTest, SeparableMatchesFullKernel) {
+    Matrix<double, 3> vol(2, 150, 300);
+    int k = 0;
+    for (auto &x : vol)
+        x = (k++ * 7919) % 101;
+
+    Matrix<double, 1> v = {1, 2, 1}, h = {1, 4, 6, 4, 1};
+    Matrix<double, 2> full(3, 5);
+    for (std::size_t a = 0; a != 3; ++a)
+        for (std::size_t b = 0; b != 5; ++b)
+            full(a, b) = v(a) * h(b);
+
+    auto sep = convolve_separable(vol, v, h, boundary::clamp);
+    auto ref = convolve(vol, full, boundary::clamp);
+    EXPECT_EQ(std::vector<double>(sep.begin(), sep.end()),
+              std::vector<double>(ref.begin(), ref.end()));
+}
+
+TEST(PackedTest, SymmetricKernels) {
+    Matrix<double, 2> full = {{4, 1, 2}, {1, 5, 3}, {2, 3, 6}};
+    SymmetricMatrix<double, triangle::upper> s(full);
+    EXPECT_EQ(s.size(), 6u);
+    EXPECT_EQ(s(2, 0), 2);
+    EXPECT_EQ(s.row(1).size(), 2u);
+
+    Matrix<double, 1> x = {1, -1, 2};
+    Matrix<double, 1> y = symv(s, x);
+    EXPECT_EQ(std::vector<double>(y.begin(), y.end()),
+              (std::vector<double>{7, 2, 11}));
+
+    Matrix<double, 2> v = {{1, 0}, {2, 1}, {0, 3}};
+    syrk(1.0, v, s); // s += v v^T
+    Matrix<double, 2> m = s.to_matrix();
+    EXPECT_EQ(m(0, 1), 3);
+    EXPECT_EQ(m(2, 1), 6);
+    EXPECT_EQ(m(2, 2), 15);
+}
+
+TEST(PackedTest, TriangularRoundTrip) {
+    Matrix<int, 2> full = {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}};
+    const TriangularMatrix<int> t(full);
+    EXPECT_EQ(t(0, 2), 0);
+    EXPECT_EQ(t(2, 1), 8);
+    Matrix<int, 2> m = t.to_matrix();
+    EXPECT_EQ(std::vector<int>(m.begin(), m.end()),
+              (std::vector<int>{1, 0, 0, 4, 5, 0, 7, 8, 9}));
+}
+
+TEST(SparseTest, CooToCsrSumsDuplicates) {
+    CooMatrix<double> coo(3, 4);
+    coo.add(2, 1, 1.0);
+    coo.add(0, 3, 2.0);
+    coo.add(2, 0, 3.0);
+    coo.add(2, 1, 4.0);
+
+    CsrMatrix<double> a(coo);
+    EXPECT_EQ(a.nnz(), 3u);
+    EXPECT_EQ(a.row_ptr(), (std::vector<std::size_t>{0, 1, 1, 3}));
+    EXPECT_EQ(a.col_indices(), (std::vector<std::size_t>{3, 0, 1}));
+    EXPECT_EQ(a(2, 1), 5.0);
+    EXPECT_EQ(a(1, 1), 0.0);
+
+    Matrix<double, 2> d = a.to_matrix();
+    EXPECT_EQ(CsrMatrix<double>(d).values(), a.values());
+}
+
+TEST(SparseTest, ProductsWithDense) {
+    Matrix<double, 2> d = {{1, 0, 2}, {0, 0, 0}, {0, 3, 0}};
+    CsrMatrix<double> a(d);
+
+    Matrix<double, 1> x = {1, 2, 3};
+    Matrix<double, 1> y = spmv(a, x);
+    EXPECT_EQ(std::vector<double>(y.begin(), y.end()),
+              (std::vector<double>{7, 0, 6}));
+
+    Matrix<double, 2, column_major> b = {{1, 2}, {3, 4}, {5, 6}};
+    Matrix<double, 2> c = spmm(a, b);
+    EXPECT_EQ(std::vector<double>(c.begin(), c.end()),
+              (std::vector<double>{11, 14, 0, 0, 9, 12}));
+}
+
+TEST(IndexingTest, TakeAndScatter) {
+    Matrix<int, 2> m = {{0, 1, 2}, {3, 4, 5}, {6, 7, 8}};
+    using v = std::vector<int>;
+
+    auto rows = take(m, 0, {2, 0, 2});
+    EXPECT_EQ(v(rows.begin(), rows.end()), (v{6, 7, 8, 0, 1, 2, 6, 7, 8}));
+    Matrix<int, 1> idx = {2, 1};
+    auto cols = take(m, 1, idx);
+    EXPECT_EQ(v(cols.begin(), cols.end()), (v{2, 1, 5, 4, 8, 7}));
+    auto none = take(Matrix<int, 2>(0, 4), 0, {});
+    EXPECT_EQ(none.extent(0), 0u);
+    EXPECT_EQ(none.extent(1), 4u);
+
+    Matrix<int, 2> z(3, 3);
+    scatter_add(z, 0, {1, 1}, take(m, 0, {0, 2}));
+    EXPECT_EQ(v(z.begin(), z.end()), (v{0, 0, 0, 6, 8, 10, 0, 0, 0}));
+    put(z, 1, {0}, Matrix<int, 2>{{-1}, {-1}, {-1}});
+    EXPECT_EQ(v(z.begin(), z.end()), (v{-1, 0, 0, -1, 8, 10, -1, 0, 0}));
+}
+
+TEST(IndexingTest, BooleanMask) {
+    Matrix<int, 2> m = {{0, 1, 2}, {3, 4, 5}};
+    Matrix<bool, 2> mask = {{true, false, false}, {false, true, true}};
+
+    Matrix<int, 1> s = select(m, mask);
+    EXPECT_EQ(std::vector<int>(s.begin(), s.end()),
+              (std::vector<int>{0, 4, 5}));
+
+    place(m, mask, Matrix<int, 1>{7, 8, 9});
+    EXPECT_EQ(std::vector<int>(m.begin(), m.end()),
+              (std::vector<int>{7, 1, 2, 3, 8, 9}));
+
+    // the storage of Matrix<bool>: moved-from is empty, like std::vector
+    matrix_impl::bool_vector a(4), b(std::move(a)), c(a);
+    EXPECT_EQ(b.size(), 4u);
+    EXPECT_TRUE(a.empty() && c.empty());
+    a = std::move(b);
+    EXPECT_EQ(a.size(), 4u);
+    EXPECT_EQ(b.size(), 0u);
+}
+
+TEST(HalfTest, Conversions) {
+    EXPECT_EQ(half(1.0f).bits, 0x3c00);
+    EXPECT_EQ(half(65504.0f).bits, 0x7bff);
+    EXPECT_EQ(half(1e6f).bits, 0x7c00);
+    EXPECT_EQ(float(half::from_bits(0x0001)), 5.960464477539063e-8f);
+    EXPECT_EQ(bfloat16(1.00390625f).bits, 0x3f80); // tie to even
+
+    Matrix<float, 2> f(3, 40);
+    float v = -2;
+    for (auto &x : f)
+        x = v += 0.125f;
+    Matrix<half, 2> h(f);
+    Matrix<float, 2> back(h);
+    EXPECT_EQ(std::vector<float>(back.begin(), back.end()),
+              std::vector<float>(f.begin(), f.end()));
+}
+
+TEST(HalfTest, FloatAccumulation) {
+    Matrix<half, 1> ones(4096);
+    for (auto &x : ones)
+        x = 1.0f;
+    // a half accumulator would stop at 2048
+    EXPECT_EQ(sum(ones), 4096.0f);
+    EXPECT_EQ(dot(ones, ones), 4096.0f);
+
+    Matrix<bfloat16, 2> a = {{1, 2}, {3, 4}};
+    Matrix<float, 2> c = multiply(a, a);
+    EXPECT_EQ(std::vector<float>(c.begin(), c.end()),
+              (std::vector<float>{7, 10, 15, 22}));
+    Matrix<bfloat16, 2> d = a + a * 2.0f - a;
+    EXPECT_EQ(float(d(1, 1)), 8.0f);
+}
+
+TEST(QuantizedTest, RoundTrip) {
+    Matrix<float, 2> m = {{-1, 0, 2.5f}, {0.25f, 10, -3}};
+    QuantizedMatrix q = quantize(m, quantization::per_row);
+    EXPECT_EQ(q(0, 1), 0.0f); // zero is exact
+    Matrix<float, 2> back = dequantize(q);
+    for (std::size_t i = 0; i != 2; ++i)
+        for (std::size_t j = 0; j != 3; ++j)
+            EXPECT_LE(std::abs(back(i, j) - m(i, j)), q.scale(i) / 2);
+
+    // clamped before rounding; NaN takes the zero point
+    const float inf = std::numeric_limits<float>::infinity();
+    EXPECT_EQ(quant_impl::quantize_one(inf, 1, 5), 127);
+    EXPECT_EQ(quant_impl::quantize_one(-inf, 1, 5), -128);
+    EXPECT_EQ(quant_impl::quantize_one(3e19f, 1, -100), 127);
+    EXPECT_EQ(quant_impl::quantize_one(-3e19f, 1, 100), -128);
+    EXPECT_EQ(quant_impl::quantize_one(std::nanf(""), 1, 5), 5);
+    EXPECT_EQ(quant_impl::quantize_one(-200, 1, 100), -100);
+}
+
+TEST(QuantizedTest, Int8Gemm) {
+    // k = 70 runs the vector loop and its scalar tail; 5 rows of b leave a
+    // partial group of 4
+    Matrix<float, 2> a(3, 70), b(5, 70);
+    float v = 0;
+    for (auto &x : a)
+        x = v = v > 4 ? -4 : v + 0.37f;
+    for (auto &x : b)
+        x = v = v < -2 ? 3 : v - 0.21f;
+    QuantizedMatrix qa = quantize(a), qb = quantize(b, quantization::per_row);
+
+    Matrix<std::int32_t, 2> c = qgemm_s32(qa, qb);
+    Matrix<float, 2> y = qgemm(qa, qb);
+    for (std::size_t i = 0; i != 3; ++i)
+        for (std::size_t j = 0; j != 5; ++j) {
+            std::int32_t s = 0;
+            float r = 0;
+            for (std::size_t p = 0; p != 70; ++p) {
+                s += qa.data()[i * 70 + p] * qb.data()[j * 70 + p];
+                r += qa(i, p) * qb(j, p);
+            }
+            EXPECT_EQ(c(i, j), s);
+            EXPECT_NEAR(y(i, j), r, 1e-3);
+        }
+
+    // rows of -1, longer than one int32 chunk: raw sums of 128^2 k and
+    // correction terms that add up past 2^31
+    const std::size_t k = 2 * 65536 + 70;
+    Matrix<float, 2> ones(1, k);
+    ones.apply([](float &x) { x = -1; });
+    const QuantizedMatrix q = quantize(ones);
+    EXPECT_NEAR(qgemm(q, q)(0, 0), float(k), 1);
+    EXPECT_THROW(qgemm_s32(q, q), std::length_error);
+}
+
+TEST(DispatchTest, SameResultsAtEveryLevel) {
+    EXPECT_LE(active_isa(), detected_isa());
+    EXPECT_STREQ(isa_name(isa::sse4_2), "sse4.2");
+
+    Matrix<float, 2> a(19, 37), b(37, 11);
+    float v = 0;
+    for (auto &x : a)
+        x = v = v > 3 ? -3 : v + 0.25f;
+    for (auto &x : b)
+        x = v = v < -3 ? 3 : v - 0.5f;
+    const isa saved = active_isa();
+    set_isa(isa::sse2);
+    EXPECT_EQ(active_isa(), isa::sse2);
+    const Matrix<float, 2> c0 = multiply(a, b), t0 = transpose(a);
+    const Matrix<half, 2> h0(a);
+    const float s0 = sum(a);
+    set_isa(detected_isa());
+    const Matrix<float, 2> c1 = multiply(a, b), t1 = transpose(a);
+    const Matrix<half, 2> h1(a);
+    set_isa(saved);
+
+    // the operands are multiples of 1/4, so every level is exact
+    EXPECT_EQ(std::vector<float>(c0.begin(), c0.end()),
+              std::vector<float>(c1.begin(), c1.end()));
+    EXPECT_EQ(std::vector<float>(t0.begin(), t0.end()),
+              std::vector<float>(t1.begin(), t1.end()));
+    EXPECT_EQ(t1(5, 3), a(3, 5));
+    for (std::size_t i = 0; i != h0.size(); ++i)
+        EXPECT_EQ(h0.data()[i].bits, h1.data()[i].bits);
+    EXPECT_EQ(s0, sum(a));
+}
+
+TEST(RandomTest, PhiloxKnownAnswers) {
+    // from the Random123 known-answer tests
+    using ctr = std::array<std::uint32_t, 4>;
+    using key = std::array<std::uint32_t, 2>;
+    EXPECT_EQ(philox4x32(ctr{{0, 0, 0, 0}}, key{{0, 0}}),
+              (ctr{{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}}));
+    EXPECT_EQ(philox4x32(ctr{{0x243f6a88, 0x85a308d3, 0x13198a2e,
+                              0x03707344}},
+                         key{{0xa4093822, 0x299f31d0}}),
+              (ctr{{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}}));
+}
+
+TEST(RandomTest, ReproducibleAcrossThreadsAndStrides) {
+    const std::size_t saved = num_threads();
+    Matrix<double, 2> a(130, 257), b(130, 257);
+    set_num_threads(1);
+    fill_random(a, normal_dist(), 42);
+    set_num_threads(5);
+    fill_random(b, normal_dist(), 42);
+    set_num_threads(saved);
+    EXPECT_EQ(std::vector<double>(a.begin(), a.end()),
+              std::vector<double>(b.begin(), b.end()));
+
+    // a strided view gets the values of a dense matrix of its extents
+    Matrix<double, 2> big(260, 300);
+    fill_random(big(slice(0, 130, 2), slice(1, 257)), normal_dist(), 42);
+    EXPECT_EQ(big(2 * 7, 1 + 9), a(7, 9));
+    EXPECT_EQ(big(1, 1), 0.0);
+
+    fill_random(b, normal_dist(), 42, 1); // another stream
+    EXPECT_NE(a(0, 0), b(0, 0));
+
+    Matrix<int, 1> dice(1000);
+    fill_random(dice, integer_dist(1, 6), 7);
+    EXPECT_EQ(*std::min_element(dice.begin(), dice.end()), 1);
+    EXPECT_EQ(*std::max_element(dice.begin(), dice.end()), 6);
+}
+
+TEST(InstrumentTest, CountsCopiesByTag) {
+    instrument_reset();
+    Matrix<double, 2> a(4, 8);
+    {
+        MATRIX_TAG("copies");
+        Matrix<double, 2> b(a);
+        Matrix<double, 2> c(a.rows(0, 1));
+        b = a;
+    }
+    traffic_stats t = instrument_traffic("copies");
+    if (!instrumented()) {
+        EXPECT_EQ(t.allocations, 0u);
+        return;
+    }
+    EXPECT_EQ(t.allocations, 2u);
+    EXPECT_EQ(t.bytes_allocated, 48 * sizeof(double));
+    EXPECT_EQ(t.copies, 3u);
+    EXPECT_EQ(t.bytes_copied, 80 * sizeof(double));
+    EXPECT_EQ(instrument_traffic("untagged").allocations, 1u);
+}
+
+TEST(InstrumentTest, TimingsAndJson) {
+    instrument_reset();
+    Matrix<float, 2> a(64, 64);
+    fill_random(a, uniform_dist(), 1);
+    sum(a);
+    sum(a);
+    op_timing t = instrument_timing("sum");
+    std::ostringstream os;
+    instrument_json(os);
+    if (!instrumented()) {
+        EXPECT_EQ(t.count, 0u);
+        EXPECT_EQ(os.str(), "{\"traffic\": {}, \"timing\": {}}");
+        return;
+    }
+    EXPECT_EQ(t.count, 2u);
+    std::size_t calls = 0;
+    for (std::size_t c : t.histogram)
+        calls += c;
+    EXPECT_EQ(calls, 2u);
+    EXPECT_NE(os.str().find("\"sum\": {\"count\": 2"), std::string::npos);
+    EXPECT_NE(os.str().find("\"fill_random\": {\"count\": 1"),
+              std::string::npos);
+}
+
+TEST(TrackedTest, RowCacheRecomputesMarkedRows) {
+    TrackedMatrix<double> m(100, 8);
+    m.apply([](double &x) { x = 1; });
+    auto sums = track_rows(m, [](const double *p, std::size_t n) {
+        return std::accumulate(p, p + n, 0.0);
+    });
+    EXPECT_EQ(sums.values()[5], 8.0);
+    EXPECT_EQ(sums.refreshed(), 100u);
+
+    m(5, 0) = 3;
+    m.row(7)(1) = -1;
+    const TrackedMatrix<double> &cm = m;
+    EXPECT_EQ(cm(9, 0), 1.0); // const reads do not mark
+    EXPECT_EQ(sums.values()[5], 10.0);
+    EXPECT_EQ(sums.values()[7], 6.0);
+    EXPECT_EQ(sums.refreshed(), 2u);
+
+    m(slice{20, 3, 2}, slice{0, 2}) = Matrix<double, 2>(3, 2);
+    EXPECT_EQ(sums.values()[24], 6.0);
+    EXPECT_EQ(sums.refreshed(), 5u); // rows 20 to 24
+}
+
+TEST(TrackedTest, ColumnCacheRefoldsDirtyBlocks) {
+    Matrix<double, 2> init(200, 3);
+    fill_random(init, uniform_dist(), 7);
+    TrackedMatrix<double> m(init);
+    auto maxes = track_columns(m, -1.0, [](double a, double b) {
+        return std::max(a, b);
+    }, 16);
+    auto expected = [&](std::size_t j) {
+        double r = -1;
+        for (std::size_t i = 0; i != m.n_rows(); ++i)
+            r = std::max(r, m.matrix()(i, j));
+        return r;
+    };
+    EXPECT_EQ(maxes.values()[1], expected(1));
+
+    m.rows(40, 41) = Matrix<double, 2>{{5, 0, 0}, {0, 0, 0}};
+    EXPECT_EQ(maxes.values()[0], 5.0);
+    EXPECT_EQ(maxes.refreshed(), 16u); // rows 32 to 47
+    m(40, 0) = 0;
+    EXPECT_EQ(maxes.values()[0], expected(0));
+    EXPECT_EQ(maxes.values()[2], expected(2));
+}
+
+TEST(RollingTest, MatchesNaiveWindows) {
+    Matrix<double, 2> x(300, 70); // time x series
+    fill_random(x, normal_dist(100, 3), 11);
+    const std::size_t w = 17;
+    for (std::size_t axis : {0, 1}) {
+        const std::size_t steps = x.extent(axis);
+        auto at = [&](std::size_t t, std::size_t s) {
+            return axis == 0 ? x(t, s) : x(s, t);
+        };
+        auto mean = rolling_mean(x, w, axis), var = rolling_var(x, w, axis);
+        auto lo = rolling_min(x, w, axis), hi = rolling_max(x, w, axis);
+        EXPECT_EQ(mean.extent(axis), steps - w + 1);
+        for (std::size_t s = 0; s < x.extent(1 - axis); s += 7)
+            for (std::size_t t = 0; t + w <= steps; t += 5) {
+                double m = 0, v = 0, a = at(t, s), b = at(t, s);
+                for (std::size_t k = t; k != t + w; ++k) {
+                    m += at(k, s) / w;
+                    a = std::min(a, at(k, s));
+                    b = std::max(b, at(k, s));
+                }
+                for (std::size_t k = t; k != t + w; ++k)
+                    v += (at(k, s) - m) * (at(k, s) - m) / (w - 1);
+                auto get = [&](const Matrix<double, 2> &r) {
+                    return axis == 0 ? r(t, s) : r(s, t);
+                };
+                EXPECT_NEAR(get(mean), m, 1e-9);
+                EXPECT_NEAR(get(var), v, 1e-8);
+                EXPECT_EQ(get(lo), a);
+                EXPECT_EQ(get(hi), b);
+            }
+    }
+}
+
+TEST(RollingTest, StreamingMatchesBatch) {
+    Matrix<float, 2> x(50, 4);
+    fill_random(x, uniform_dist(-1, 1), 5);
+    RollingWindow<float> win(4, 8);
+    auto var = rolling_var(x, 8);
+    auto hi = rolling_max(x, 8);
+    for (std::size_t t = 0; t != x.n_rows(); ++t) {
+        win.push(x.row(t));
+        EXPECT_EQ(win.count(), std::min<std::size_t>(t + 1, 8));
+        if (!win.full())
+            continue;
+        for (std::size_t s = 0; s != 4; ++s) {
+            EXPECT_NEAR(win.var()(s), var(t - 7, s), 1e-6);
+            EXPECT_EQ(win.max()(s), hi(t - 7, s));
+        }
+    }
+}
+
+TEST(GrowTest, AppendRows) {
+    Matrix<double, 2> m;
+    Matrix<double, 2> src = {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}};
+    for (std::size_t i = 0; i != 100; ++i) {
+        auto r = m.append_row(src.col(i % 3)); // strided source
+        EXPECT_EQ(r(2), src(2, i % 3));
+    }
+    EXPECT_EQ(m.n_rows(), 100u);
+    EXPECT_EQ(m.n_cols(), 3u);
+    EXPECT_EQ(m.size(), 300u);
+    EXPECT_EQ(m(40, 1), 5);
+    EXPECT_GE(m.row_capacity(), 100u);
+
+    m.reserve_rows(200);
+    const double *p = m.data();
+    auto first = m.row(0);
+    for (std::size_t i = 100; i != 200; ++i)
+        m.append_row().apply([i](double &x) { x = double(i); });
+    EXPECT_EQ(m.data(), p); // reserved: no reallocation
+    EXPECT_EQ(first(2), 7);
+    EXPECT_EQ(m(150, 0), 150);
+
+    m.shrink_to_fit();
+    EXPECT_EQ(m.row_capacity(), 200u);
+    EXPECT_EQ(m(199, 2), 199);
+
+    m.append_row(m.row(0)); // its own row, at capacity
+    m.shrink_to_fit();
+    m.append_row(m.col(1)(slice(0, 3))); // a strided view of it
+    EXPECT_EQ(m.n_rows(), 202u);
+    EXPECT_TRUE(std::equal(m.row(0).begin(), m.row(0).end(),
+                           m.row(200).begin()));
+    EXPECT_EQ(m(201, 2), m(2, 1));
+
+    Matrix<double, 2> r; // no row extents yet: give them
+    r.reserve_rows(1000, 3);
+    EXPECT_EQ(r.n_cols(), 3u);
+    EXPECT_EQ(r.row_capacity(), 1000u);
+    const double *q = r.data();
+    for (std::size_t i = 0; i != 1000; ++i)
+        r.append_row(src.row(i % 3));
+    EXPECT_EQ(r.data(), q);
+    EXPECT_EQ(r(999, 2), 3);
+}
+
+TEST(GrowTest, AppendElementsAndBools) {
+    Matrix<int, 1> v;
+    for (int i = 0; i != 1000; ++i)
+        v.append_row(i);
+    EXPECT_EQ(v.extent(0), 1000u);
+    EXPECT_EQ(std::accumulate(v.begin(), v.end(), 0), 999 * 1000 / 2);
+    v.shrink_to_fit();
+    v.append_row(v(7)); // its own element, at capacity
+    EXPECT_EQ(v(1000), 7);
+
+    Matrix<bool, 2> b(0, 2);
+    for (int i = 0; i != 50; ++i)
+        b.append_row()(i % 2) = true;
+    EXPECT_EQ(b.n_rows(), 50u);
+    EXPECT_TRUE(b(3, 1));
+    EXPECT_FALSE(b(3, 0));
+    b.shrink_to_fit();
+    EXPECT_EQ(b.row_capacity(), 50u);
+}
+
+namespace {
+// The DFT of every row of x, straight from the definition
+Matrix<std::complex<double>, 2> naive_dft(const Matrix<double, 2> &x) {
+    const std::size_t n = x.n_cols();
+    Matrix<std::complex<double>, 2> out(x.n_rows(), n);
+    for (std::size_t i = 0; i != x.n_rows(); ++i)
+        for (std::size_t k = 0; k != n; ++k)
+            for (std::size_t t = 0; t != n; ++t)
+                out(i, k) += x(i, t) *
+                             std::polar(1.0, -2 * M_PI * double(t * k % n) / n);
+    return out;
+}
+} // namespace
+
+TEST(FFTTest, MatchesNaiveDFT) {
+    for (std::size_t n : {1, 2, 3, 4, 5, 6, 8, 12, 16, 28, 30, 64, 97, 120}) {
+        Matrix<double, 2> x(19, n);
+        fill_random(x, normal_dist(0, 1), n);
+        const auto ref = naive_dft(x);
+        const auto f = fft(x);
+        const auto r = rfft(x);
+        const auto back = ifft(f);
+        const auto rback = irfft(r, n);
+        EXPECT_EQ(r.extent(1), n / 2 + 1);
+        for (std::size_t i = 0; i != x.n_rows(); ++i)
+            for (std::size_t k = 0; k != n; ++k) {
+                EXPECT_NEAR(std::abs(f(i, k) - ref(i, k)), 0, 1e-9 * n);
+                if (k <= n / 2) {
+                    EXPECT_NEAR(std::abs(r(i, k) - ref(i, k)), 0, 1e-9 * n);
+                }
+                EXPECT_NEAR(std::abs(back(i, k) - x(i, k)), 0, 1e-12 * n);
+                EXPECT_NEAR(rback(i, k), x(i, k), 1e-12 * n);
+            }
+    }
+
+    Matrix<double, 2> empty(3, 0); // empty lines: empty transforms
+    EXPECT_EQ(fft(empty).extent(1), 0u);
+    EXPECT_EQ(rfft(empty).extent(1), 0u);
+    EXPECT_EQ(rfft(empty).extent(0), 3u);
+}
+
+TEST(FFTTest, AlongAnyAxisOfViews) {
+    Matrix<float, 3> cube(40, 6, 5); // time x rows x cols
+    fill_random(cube, uniform_dist(-1, 1), 3);
+    auto view = cube(slice{0, 32}, slice{1, 4}, slice{0, 3, 2}); // strided
+    const auto f = fft(view, 0);
+    const auto r = rfft(view, 0);
+    ASSERT_EQ(f.extent(0), 32u);
+    ASSERT_EQ(r.extent(0), 17u);
+    for (std::size_t i = 0; i != 4; ++i)
+        for (std::size_t j = 0; j != 3; ++j) {
+            Matrix<double, 2> line(1, 32);
+            for (std::size_t t = 0; t != 32; ++t)
+                line(0, t) = view(t, i, j);
+            const auto ref = naive_dft(line);
+            for (std::size_t k = 0; k != 32; ++k) {
+                EXPECT_NEAR(f(k, i, j).real(), ref(0, k).real(), 1e-4);
+                EXPECT_NEAR(f(k, i, j).imag(), ref(0, k).imag(), 1e-4);
+                if (k <= 16) {
+                    EXPECT_NEAR(std::abs(r(k, i, j) - f(k, i, j)), 0, 1e-4);
+                }
+            }
+        }
+    const auto back = irfft(r, 32, 0);
+    for (std::size_t t = 0; t != 32; ++t)
+        EXPECT_NEAR(back(t, 2, 1), view(t, 2, 1), 1e-5);
+
+    Matrix<std::complex<double>, 1> v(24);
+    v(5) = 1;
+    const auto spike = fft(v);
+    EXPECT_NEAR(std::abs(spike(7) - std::polar(1.0, -2 * M_PI * 35 / 24)),
+                0, 1e-12);
+}
+
+TEST(ConcurrentTest, PartitionsAreDisjointAndCover) {
+    Matrix<int, 2> m(10, 7);
+    for (std::size_t axis : {0, 1}) {
+        auto parts = partition(m, axis, 4);
+        ASSERT_EQ(parts.size(), 4u);
+        for (std::size_t c = 0; c != parts.size(); ++c)
+            parts[c].apply([c](int &x) { x += int(c) + 1; });
+        for (int x : m)
+            EXPECT_GE(x, 1);
+        EXPECT_EQ(std::accumulate(m.begin(), m.end(), 0),
+                  axis == 0 ? 7 * (2 * 1 + 3 * 2 + 2 * 3 + 3 * 4)
+                            : 10 * (1 * 1 + 2 * 2 + 2 * 3 + 2 * 4));
+        m.apply([](int &x) { x = 0; });
+    }
+    EXPECT_EQ(partition(m.cols(1, 2), 1, 5).size(), 2u); // capped at extent
+
+    const Matrix<int, 2> &cm = m;
+    auto t = tiles(cm, 4, 3); // 3 x 3 tiles, views of const int
+    ASSERT_EQ(t.size(), 9u);
+    EXPECT_EQ(t[8].extent(0), 2u);
+    EXPECT_EQ(t[8].extent(1), 1u);
+    std::size_t total = 0;
+    for (const auto &v : t)
+        total += v.size();
+    EXPECT_EQ(total, m.size());
+}
+
+TEST(ConcurrentTest, AccumulatorMatchesSerialSums) {
+    const std::size_t threads = 4, updates = 20000;
+    Matrix<double, 2> expected(64, 32);
+    for (std::size_t c = 0; c != threads; ++c)
+        for (std::size_t u = 0; u != updates; ++u) {
+            // thread 0 updates rows 0-7 densely, the others scatter sparsely
+            const std::size_t i = c == 0 ? u % 8 : (u * 7919 + c) % 64;
+            expected(i, (u * 31 + c) % 32) += 1;
+        }
+    // its locals point back at it, so it must stay where it was made
+    static_assert(
+        !std::is_move_constructible<ConcurrentAccumulator<double, 2>>::value,
+        "ConcurrentAccumulator must not move");
+    for (std::size_t hot_after :
+         {std::size_t(0), std::size_t(1),
+          std::numeric_limits<std::size_t>::max()}) {
+        Matrix<double, 2> m(64, 32);
+        ConcurrentAccumulator<double, 2> acc(m, threads, 8, hot_after);
+        matrix_impl::parallel_tasks(threads, [&](std::size_t c) {
+            auto &local = acc.local(c);
+            for (std::size_t u = 0; u != updates; ++u) {
+                const std::size_t i = c == 0 ? u % 8 : (u * 7919 + c) % 64;
+                local.add(1.0, i, (u * 31 + c) % 32);
+            }
+        });
+        acc.merge();
+        EXPECT_TRUE(std::equal(m.begin(), m.end(), expected.begin()));
+        if (hot_after == 1) {
+            EXPECT_EQ(acc.private_regions(), 1u + 3u * 8u);
+        } else if (hot_after != 0) {
+            EXPECT_EQ(acc.private_regions(), 0u);
+        } else {
+            EXPECT_GE(acc.private_regions(), 1u);
+        }
+    }
+}
+
+TEST(SortTest, SortAndArgsortAlongEitherAxis) {
+    Matrix<double, 2> x(37, 50);
+    fill_random(x, normal_dist(0, 1), 8);
+    x(3, 4) = NAN;
+    for (std::size_t axis : {0, 1}) {
+        Matrix<double, 2> s = x;
+        sort(s, axis);
+        const auto idx = argsort(x, axis);
+        for (std::size_t l = 0; l != x.extent(1 - axis); ++l) {
+            auto line = axis == 0 ? s.col(l) : MatrixRef<double, 1>(s.row(l));
+            for (std::size_t j = 0; j != line.extent(0); ++j) {
+                const std::size_t i = idx(axis == 0 ? j : l, axis == 0 ? l : j);
+                const double orig = axis == 0 ? x(i, l) : x(l, i);
+                if (std::isnan(orig)) {
+                    EXPECT_TRUE(std::isnan(line(j))); // NaN sorts last
+                    EXPECT_EQ(j, line.extent(0) - 1);
+                } else {
+                    EXPECT_EQ(line(j), orig);
+                }
+                if (j != 0 && !std::isnan(line(j))) {
+                    EXPECT_LE(line(j - 1), line(j));
+                }
+            }
+        }
+    }
+    Matrix<int, 2> m = {{3, 1, 2}, {9, 7, 8}};
+    sort(m.col(0)); // a strided temporary view
+    EXPECT_EQ(m(0, 0), 3);
+    sort(m.row(1));
+    EXPECT_EQ(m(1, 0), 7);
+    EXPECT_EQ(m(1, 2), 9);
+
+    Matrix<double, 2> empty(3, 0); // lines of no elements
+    sort(empty);
+    sort(empty, 0);
+    EXPECT_EQ(argsort(empty).size(), 0u);
+    EXPECT_EQ(topk(empty, 0).values.size(), 0u);
+}
+
+TEST(SortTest, TopkMatchesFullSort) {
+    Matrix<float, 2> x(6, 20000);
+    fill_random(x, uniform_dist(0, 1000), 4);
+    x(2, 123) = x(2, 456) = 5000; // a tie: the lower index first
+    for (std::size_t k : {1, 5, 100, 3000}) {
+        const auto t = topk(x, k);
+        ASSERT_EQ(t.values.extent(1), k);
+        for (std::size_t i = 0; i != x.n_rows(); ++i) {
+            std::vector<float> row(x.row(i).begin(), x.row(i).end());
+            std::sort(row.begin(), row.end(), std::greater<float>());
+            for (std::size_t j = 0; j != k; ++j) {
+                EXPECT_EQ(t.values(i, j), row[j]);
+                EXPECT_EQ(x(i, t.indices(i, j)), t.values(i, j));
+            }
+        }
+        EXPECT_EQ(t.indices(2, 0), 123u);
+    }
+    const auto col = topk(x.cols(0, 9), 3, 0); // along a strided axis
+    for (std::size_t j = 0; j != 10; ++j) {
+        std::vector<float> c(x.col(j).begin(), x.col(j).end());
+        std::sort(c.begin(), c.end(), std::greater<float>());
+        EXPECT_EQ(col.values(0, j), c[0]);
+        EXPECT_EQ(col.values(2, j), c[2]);
+    }
+}
+
+TEST(CsvTest, ParsesNumbersAndOddFields) {
+    const std::string text = "a,b,c\r\n"
+                             "1, -2.5e3 ,0.1\r\n"
+                             "\r\n"
+                             "7,,nan\n"
+                             "0.12345678901234567890123,1e-300,x\n"
+                             "4,5\n"
+                             "-0,+3.,.5,9";
+    const Matrix<double, 2> m = parse_csv<double>(text, ',', 1);
+    ASSERT_EQ(m.extent(0), 5u);
+    ASSERT_EQ(m.extent(1), 3u);
+    EXPECT_EQ(m(0, 1), -2500.0);
+    EXPECT_EQ(m(0, 2), 0.1);
+    EXPECT_TRUE(std::isnan(m(1, 1)) && std::isnan(m(1, 2)));
+    EXPECT_EQ(m(2, 0), std::strtod("0.12345678901234567890123", nullptr));
+    EXPECT_EQ(m(2, 1), 1e-300);
+    EXPECT_TRUE(std::isnan(m(2, 2)) && std::isnan(m(3, 2)));
+    EXPECT_EQ(m(4, 1), 3.0);
+    EXPECT_EQ(m(4, 2), 0.5);
+
+    const Matrix<int, 2> i = parse_csv<int>("-7\t1e3\t99999999999\n", '\t');
+    EXPECT_EQ(i(0, 0), -7);
+    EXPECT_EQ(i(0, 1), 1000);
+    EXPECT_EQ(i(0, 2), std::numeric_limits<int>::max());
+
+    // the fast path rounds floats as strtof does
+    std::mt19937 gen(7);
+    std::string floats;
+    std::vector<std::string> fields;
+    for (int r = 0; r != 2000; ++r) {
+        const std::string f =
+            std::to_string(gen() % 100000000) + "." +
+            std::to_string(gen() % 100000) + "e" +
+            std::to_string(int(gen() % 31) - 15);
+        fields.push_back(f);
+        floats += f + "\n";
+    }
+    const Matrix<float, 2> f = parse_csv<float>(floats);
+    for (std::size_t r = 0; r != fields.size(); ++r)
+        EXPECT_EQ(f(r, 0), std::strtof(fields[r].c_str(), nullptr));
+}
+
+namespace {
+// A file holding text under a name of its own in the temporary directory,
+// removed when it goes out of scope
+struct temp_file {
+    std::string path;
+
+    explicit temp_file(const std::string &text) {
+        const char *dir = std::getenv("TMPDIR");
+        std::random_device rd;
+        path = std::string(dir && *dir ? dir : "/tmp") + "/matrix_test_" +
+               std::to_string(rd()) + std::to_string(rd());
+        std::ofstream(path, std::ios::binary) << text;
+    }
+    ~temp_file() { std::remove(path.c_str()); }
+};
+} // namespace
+
+TEST(CsvTest, LoadAndStreamFromFile) {
+    const std::size_t saved = num_threads();
+    set_num_threads(3);
+    Matrix<double, 2> expect(60000, 6);
+    fill_random(expect, uniform_dist(-2000, 2000), 9);
+    std::string text = "x\ty\tz\tu\tv\tw\n";
+    for (std::size_t i = 0; i != expect.n_rows(); ++i)
+        for (std::size_t j = 0; j != 6; ++j) {
+            expect(i, j) = std::floor(expect(i, j) * 64) / 64; // exact
+            text += std::to_string(expect(i, j)) + (j == 5 ? "\n" : "\t");
+        }
+    const temp_file file(text);
+    const std::string &path = file.path;
+
+    const Matrix<double, 2> m = load_csv<double>(path, '\t', 1);
+    ASSERT_EQ(m.extent(0), expect.extent(0));
+    ASSERT_EQ(m.extent(1), 6u);
+    EXPECT_TRUE(std::equal(m.begin(), m.end(), expect.begin()));
+
+    // blocks far smaller than the file, and than a line at first
+    std::size_t seen = 0, blocks = 0;
+    const std::size_t rows = stream_csv<double>(
+        path,
+        [&](MatrixRef<const double, 2> b, std::size_t first) {
+            EXPECT_EQ(first, seen);
+            EXPECT_TRUE(std::equal(b.begin(), b.end(),
+                                   expect.rows(first, first + b.n_rows() - 1)
+                                       .begin()));
+            seen += b.n_rows();
+            ++blocks;
+        },
+        '\t', 1, 16);
+    EXPECT_EQ(rows, expect.n_rows());
+    EXPECT_EQ(seen, expect.n_rows());
+    EXPECT_GT(blocks, 1u);
+
+    const std::string missing = path + ".missing";
+    EXPECT_THROW(load_csv<float>(missing), std::runtime_error);
+    EXPECT_THROW(stream_csv<float>(missing,
+                                   [](MatrixRef<const float, 2>,
+                                      std::size_t) {}),
+                 std::runtime_error);
+    set_num_threads(saved);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();